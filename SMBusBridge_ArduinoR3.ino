@@ -8,11 +8,14 @@
 #define F_CPU 16000000UL
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
 
 extern "C" {
 #include "src/smbus_bridge.h"
 #include "src/arduino_drivers.h"
 #include "src/arduino_errors.h"
+#include "src/macros.h"
+#include "src/cache.h"
 }
 
 uint8_t I2C_status = I2C_NO_ERROR;
@@ -24,8 +27,14 @@ int main(void)
   
   DDRC |= 0b00110000;     // Make only the I2C pins (PC4/5) outputs
   
-  UART_init(1000000, 1); // Set UART baud to 2 Mbaud
-  I2C_init(); // Start I2C at default of 100 kHz
+  system_error_handler(UART_init(1000000, 1)); // Set UART baud to 2 Mbaud
+  system_error_handler(I2C_init()); // Start I2C at default of 100 kHz
+  system_error_handler(TIMER_init()); // Free running tick for scheduled polls
+  MACRO_init(); // Stored transaction macros from EEPROM
+  CACHE_init(); // Read cache starts off, with the identification registers allowed
+  system_error_handler(ALERT_init()); // SMBALERT# on D2
+  
+  sei(); // UART transmit buffer is drained from its interrupt
   
     /* Replace with your application code */
     while (1) 
@@ -0,0 +1,22 @@
+/*
+ * firmware.cpp
+ *
+ * The bridge firmware built as one host translation unit against the simulated register layer in include/.
+ * The sketch's main() is renamed so the simulator can own the process entry point.
+ */
+
+#define main firmware_main
+
+#include "../src/arduino_errors.c"
+#include "../src/stats.c"
+#include "../src/trace.c"
+#include "../src/cache.c"
+#include "../src/arduino_drivers.c"
+#include "../src/crc8.c"
+#include "../src/binary_protocol.c"
+#include "../src/i2c_engine.c"
+#include "../src/poller.c"
+#include "../src/macros.c"
+#include "../src/i2c_eeprom.c"
+#include "../src/smbus_bridge.c"
+#include "../SMBusBridge_ArduinoR3.ino"
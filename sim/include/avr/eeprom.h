@@ -0,0 +1,19 @@
+/*
+ * avr/eeprom.h (host simulation)
+ */
+
+#ifndef SIM_AVR_EEPROM_H_
+#define SIM_AVR_EEPROM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define E2END	0x3FF
+
+// Reads take a few cycles a byte, every byte an update actually changes busy waits for its erase and write like the EEPE loop does
+uint8_t eeprom_read_byte(const uint8_t *address);
+void eeprom_read_block(void *destination, const void *source, size_t length);
+void eeprom_update_byte(uint8_t *address, uint8_t value);
+void eeprom_update_block(const void *source, void *destination, size_t length);
+
+#endif /* SIM_AVR_EEPROM_H_ */
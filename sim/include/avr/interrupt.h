@@ -0,0 +1,23 @@
+/*
+ * avr/interrupt.h (host simulation)
+ */
+
+#ifndef SIM_AVR_INTERRUPT_H_
+#define SIM_AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+void sim_sei(void);
+void sim_cli(void);
+
+#define sei()	sim_sei()
+#define cli()	sim_cli()
+
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR_NAKED
+
+// Handlers get C linkage so the simulator can find them through weak references
+#define ISR(vector, ...) extern "C" void vector(void); extern "C" void vector(void)
+
+#endif /* SIM_AVR_INTERRUPT_H_ */
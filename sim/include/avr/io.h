@@ -0,0 +1,199 @@
+/*
+ * avr/io.h (host simulation)
+ *
+ * Register layer used when the firmware is built for the host simulator. Every
+ * peripheral register is a proxy object, so reads and writes are routed through
+ * the simulator which models the ATmega328P TWI, USART, Timer1, GPIO and pin change blocks and
+ * charges CPU cycles for each access.
+ */
+
+#ifndef SIM_AVR_IO_H_
+#define SIM_AVR_IO_H_
+
+#include <stdint.h>
+
+enum SIM_REGISTERS{
+	SIM_PINB,
+	SIM_DDRB,
+	SIM_PORTB,
+	SIM_PINC,
+	SIM_DDRC,
+	SIM_PORTC,
+	SIM_PIND,
+	SIM_DDRD,
+	SIM_PORTD,
+	SIM_TWBR,
+	SIM_TWSR,
+	SIM_TWAR,
+	SIM_TWDR,
+	SIM_TWCR,
+	SIM_UCSR0A,
+	SIM_UCSR0B,
+	SIM_UCSR0C,
+	SIM_UBRR0L,
+	SIM_UBRR0H,
+	SIM_UDR0,
+	SIM_TCCR1A,
+	SIM_TCCR1B,
+	SIM_TIMSK1,
+	SIM_TIFR1,
+	SIM_TCNT1,
+	SIM_OCR1A,
+	SIM_PCICR,
+	SIM_PCIFR,
+	SIM_PCMSK2,
+	SIM_SREG,
+	SIM_REGISTER_COUNT
+};
+
+uint8_t sim_io_read(uint8_t reg);
+void sim_io_write(uint8_t reg, uint8_t value);
+uint16_t sim_io_read16(uint8_t reg);
+void sim_io_write16(uint8_t reg, uint16_t value);
+
+// Proxy for one 8 bit I/O register. Compound assignments are read-modify-write, exactly like the sbi/cbi-free code avr-gcc emits for them.
+class sim_io8{
+public:
+	explicit constexpr sim_io8(uint8_t reg) : reg(reg) {}
+
+	operator uint8_t() const { return sim_io_read(reg); }
+
+	const sim_io8 &operator=(uint8_t value) const { sim_io_write(reg, value); return *this; }
+	const sim_io8 &operator|=(uint8_t value) const { sim_io_write(reg, sim_io_read(reg) | value); return *this; }
+	const sim_io8 &operator&=(uint8_t value) const { sim_io_write(reg, sim_io_read(reg) & value); return *this; }
+	const sim_io8 &operator^=(uint8_t value) const { sim_io_write(reg, sim_io_read(reg) ^ value); return *this; }
+
+private:
+	uint8_t reg;
+};
+
+// Proxy for a 16 bit timer register, accessed in one go as the TEMP register makes it look to the firmware
+class sim_io16{
+public:
+	explicit constexpr sim_io16(uint8_t reg) : reg(reg) {}
+
+	operator uint16_t() const { return sim_io_read16(reg); }
+
+	const sim_io16 &operator=(uint16_t value) const { sim_io_write16(reg, value); return *this; }
+
+private:
+	uint8_t reg;
+};
+
+#define PINB	(sim_io8(SIM_PINB))
+#define DDRB	(sim_io8(SIM_DDRB))
+#define PORTB	(sim_io8(SIM_PORTB))
+#define PINC	(sim_io8(SIM_PINC))
+#define DDRC	(sim_io8(SIM_DDRC))
+#define PORTC	(sim_io8(SIM_PORTC))
+#define PIND	(sim_io8(SIM_PIND))
+#define DDRD	(sim_io8(SIM_DDRD))
+#define PORTD	(sim_io8(SIM_PORTD))
+#define TWBR	(sim_io8(SIM_TWBR))
+#define TWSR	(sim_io8(SIM_TWSR))
+#define TWAR	(sim_io8(SIM_TWAR))
+#define TWDR	(sim_io8(SIM_TWDR))
+#define TWCR	(sim_io8(SIM_TWCR))
+#define UCSR0A	(sim_io8(SIM_UCSR0A))
+#define UCSR0B	(sim_io8(SIM_UCSR0B))
+#define UCSR0C	(sim_io8(SIM_UCSR0C))
+#define UBRR0L	(sim_io8(SIM_UBRR0L))
+#define UBRR0H	(sim_io8(SIM_UBRR0H))
+#define UDR0	(sim_io8(SIM_UDR0))
+#define TCCR1A	(sim_io8(SIM_TCCR1A))
+#define TCCR1B	(sim_io8(SIM_TCCR1B))
+#define TIMSK1	(sim_io8(SIM_TIMSK1))
+#define TIFR1	(sim_io8(SIM_TIFR1))
+#define TCNT1	(sim_io16(SIM_TCNT1))
+#define OCR1A	(sim_io16(SIM_OCR1A))
+#define PCICR	(sim_io8(SIM_PCICR))
+#define PCIFR	(sim_io8(SIM_PCIFR))
+#define PCMSK2	(sim_io8(SIM_PCMSK2))
+#define SREG	(sim_io8(SIM_SREG))
+
+// Port bits
+#define PORTB0	0
+#define PORTB1	1
+#define PORTB2	2
+#define PORTB3	3
+#define PORTB4	4
+#define PORTB5	5
+#define PORTC0	0
+#define PORTC1	1
+#define PORTC2	2
+#define PORTC3	3
+#define PORTC4	4
+#define PORTC5	5
+#define PINC4	4
+#define PINC5	5
+#define PORTD2	2
+#define PIND2	2
+
+// TWCR
+#define TWINT	7
+#define TWEA	6
+#define TWSTA	5
+#define TWSTO	4
+#define TWWC	3
+#define TWEN	2
+#define TWIE	0
+
+// TWSR
+#define TWPS1	1
+#define TWPS0	0
+
+// UCSR0A
+#define RXC0	7
+#define TXC0	6
+#define UDRE0	5
+#define FE0	4
+#define DOR0	3
+#define UPE0	2
+#define U2X0	1
+#define MPCM0	0
+
+// UCSR0B
+#define RXCIE0	7
+#define TXCIE0	6
+#define UDRIE0	5
+#define RXEN0	4
+#define TXEN0	3
+#define UCSZ02	2
+
+// UCSR0C
+#define UCSZ01	2
+#define UCSZ00	1
+
+// TCCR1B
+#define WGM13	4
+#define WGM12	3
+#define CS12	2
+#define CS11	1
+#define CS10	0
+
+// TIMSK1
+#define OCIE1A	1
+#define TOIE1	0
+
+// TIFR1
+#define OCF1A	1
+#define TOV1	0
+
+// PCICR, PCIFR and PCMSK2
+#define PCIE2	2
+#define PCIF2	2
+#define PCINT18	2
+
+// SREG
+#define SREG_I	7
+
+// Interrupt vectors, dispatched by the simulator when their enable and flag bits are both set
+#define PCINT2_vect	sim_vector_PCINT2
+#define TIMER1_COMPA_vect	sim_vector_TIMER1_COMPA
+#define TIMER1_OVF_vect	sim_vector_TIMER1_OVF
+#define USART_RX_vect	sim_vector_USART_RX
+#define USART_UDRE_vect	sim_vector_USART_UDRE
+#define USART_TX_vect	sim_vector_USART_TX
+#define TWI_vect	sim_vector_TWI
+
+#endif /* SIM_AVR_IO_H_ */
@@ -0,0 +1,16 @@
+/*
+ * avr/pgmspace.h (host simulation)
+ *
+ * Flash and SRAM share one address space on the host, so program memory reads are plain loads.
+ */
+
+#ifndef SIM_AVR_PGMSPACE_H_
+#define SIM_AVR_PGMSPACE_H_
+
+#include <stdint.h>
+
+#define PROGMEM
+
+#define pgm_read_byte(address)	(*(const uint8_t *)(address))
+
+#endif /* SIM_AVR_PGMSPACE_H_ */
@@ -0,0 +1,19 @@
+/*
+ * avr/sleep.h (host simulation)
+ */
+
+#ifndef SIM_AVR_SLEEP_H_
+#define SIM_AVR_SLEEP_H_
+
+void sim_sleep(void);
+
+#define SLEEP_MODE_IDLE		0
+
+#define set_sleep_mode(mode)	((void)(mode))
+#define sleep_enable()
+#define sleep_disable()
+
+// Skips ahead to the next peripheral or host event instead of burning simulated cycles one access at a time
+#define sleep_cpu()		sim_sleep()
+
+#endif /* SIM_AVR_SLEEP_H_ */
@@ -0,0 +1,18 @@
+/*
+ * util/delay.h (host simulation)
+ */
+
+#ifndef SIM_UTIL_DELAY_H_
+#define SIM_UTIL_DELAY_H_
+
+void sim_delay_us(double us);
+
+static inline void _delay_us(double us){
+	sim_delay_us(us);
+}
+
+static inline void _delay_ms(double ms){
+	sim_delay_us(ms * 1000.0);
+}
+
+#endif /* SIM_UTIL_DELAY_H_ */
@@ -0,0 +1,920 @@
+/*
+ * sim_core.cpp
+ *
+ * Host model of the ATmega328P peripherals used by the bridge with cycle accounting.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <util/delay.h>
+
+#include "sim_core.h"
+#include "sim_targets.h"
+
+SimConfig sim_config;
+
+// Interrupt handlers the firmware may or may not define
+extern "C" void sim_vector_USART_RX(void) __attribute__((weak));
+extern "C" void sim_vector_USART_UDRE(void) __attribute__((weak));
+extern "C" void sim_vector_USART_TX(void) __attribute__((weak));
+extern "C" void sim_vector_TWI(void) __attribute__((weak));
+extern "C" void sim_vector_TIMER1_COMPA(void) __attribute__((weak));
+extern "C" void sim_vector_TIMER1_OVF(void) __attribute__((weak));
+extern "C" void sim_vector_PCINT2(void) __attribute__((weak));
+
+#define SIM_ISR_CYCLES	10	// Vector fetch, prologue and reti overhead
+#define SIM_EEPROM_WRITE_US	3400	// Erase and write of one byte, tWD_EEPROM
+
+enum SIM_TWI_OPERATIONS{
+	TWI_IDLE,
+	TWI_START,
+	TWI_STOP,
+	TWI_ADDRESS,
+	TWI_WRITE,
+	TWI_READ
+};
+
+static uint64_t now;
+static uint64_t last_activity;
+static uint8_t regs[SIM_REGISTER_COUNT];
+static bool in_isr;
+
+static SimHost *host;
+static std::vector<SimTarget *> targets;
+static SimAlertResponder alert_responder;
+
+// SMBALERT# on PD2, pulled up and wired-AND with every target
+static struct{
+	bool low;
+
+	// Statistics
+	uint64_t assertions;
+} alert;
+
+static struct{
+	uint8_t status = 0xF8;
+	uint8_t operation = TWI_IDLE;
+	uint64_t done_at = SIM_NEVER;
+	uint8_t next_status;
+	uint8_t next_data;
+	bool bus_owned;
+	bool start_pending;
+	SimTarget *target;
+	uint64_t stretch_from;		// A stretching target holds SCL low after the byte's last clock
+	uint64_t stretch_until;
+
+	// Statistics
+	uint64_t transaction_start;
+	uint64_t transaction_clock;
+	std::string transaction_trace;
+	uint64_t transactions;
+	uint64_t bytes;
+	uint64_t nacks;
+	uint64_t peripheral_resets;
+	uint64_t busy_cycles;
+	uint64_t clock_cycles;
+	uint64_t stretch_cycles;
+} twi;
+
+static struct{
+	uint8_t rx_fifo[2];
+	uint8_t rx_count;
+	bool overrun;
+	bool tx_complete;
+	bool shift_busy;
+	uint8_t shift_data;
+	uint64_t shift_done = SIM_NEVER;
+	bool buffer_full;
+	uint8_t buffer_data;
+	std::deque<uint8_t> host_queue;
+	uint64_t host_byte_at = SIM_NEVER;
+	bool host_paused;		// XOFF seen, the byte already on the wire still arrives
+
+	// Statistics
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+	uint64_t overruns;
+	uint64_t tx_dropped;
+	uint64_t rx_disabled;
+	uint64_t tx_active_cycles;
+} uart;
+
+// Timer1 in normal mode, the count is worked out from the cycle counter instead of being ticked
+static struct{
+	uint64_t start;			// Cycle at which the count was last zero, all tick boundaries are a whole prescale after it
+	uint32_t prescale;		// CPU cycles per count, 0 while stopped
+	uint16_t stopped_count;
+	uint16_t compare;
+	uint64_t overflow_at = SIM_NEVER;
+	uint64_t compare_at = SIM_NEVER;
+} timer;
+
+static void tick(uint64_t cycles);
+static void dispatch_interrupts();
+
+/*
+
+Time keeping
+
+*/
+
+uint64_t sim_now(){
+	return now;
+}
+
+double sim_us(uint64_t cycles){
+	return (double)cycles * 1000000.0 / (double)F_CPU;
+}
+
+uint64_t sim_cycles(double us){
+	return (uint64_t)(us * ((double)F_CPU / 1000000.0) + 0.5);
+}
+
+void sim_log(int level, const char *format, ...){
+	if(sim_config.verbosity < level) return;
+
+	va_list args;
+	va_start(args, format);
+	printf("[%12.3f us] ", sim_us(now));
+	vprintf(format, args);
+	printf("\n");
+	va_end(args);
+}
+
+void sim_attach_host(SimHost *new_host){
+	host = new_host;
+}
+
+void sim_attach_target(SimTarget *target){
+	targets.push_back(target);
+}
+
+SimTarget *sim_find_target(uint8_t address){
+	for(SimTarget *target : targets){
+		if(target->address == address) return target;
+	}
+
+	// Nobody claims the Alert Response Address, so it answers for the alerting targets
+	return (address == SIM_ALERT_RESPONSE_ADDRESS) ? &alert_responder : nullptr;
+}
+
+// Lowest address wins the arbitration on an Alert Response Address read
+SimTarget *sim_alerting_target(){
+	SimTarget *lowest = nullptr;
+
+	for(SimTarget *target : targets){
+		if(target->alerting && target->answers_ara && !target->absent && (!lowest || (target->address < lowest->address))) lowest = target;
+	}
+	return lowest;
+}
+
+void sim_alert_update(){
+	bool low = false;
+
+	for(SimTarget *target : targets) low |= target->alerting;
+
+	if(low == alert.low) return;
+
+	alert.low = low;
+	alert.assertions += low;
+	last_activity = now;
+	sim_log(2, "smbalert %s", low ? "asserted" : "released");
+
+	// Either edge sets the flag while the pin is unmasked
+	if(regs[SIM_PCMSK2] & (1 << PCINT18)) regs[SIM_PCIFR] |= (1 << PCIF2);
+}
+
+/*
+
+USART0
+
+*/
+
+static uint64_t uart_frame_cycles(){
+	uint32_t ubrr = ((regs[SIM_UBRR0H] & 0x0F) << 8) | regs[SIM_UBRR0L];
+	uint32_t divider = (regs[SIM_UCSR0A] & (1 << U2X0)) ? 8 : 16;
+
+	// Start bit, 8 data bits and a stop bit
+	return 10ULL * divider * (ubrr + 1);
+}
+
+void sim_host_transmit(uint8_t data){
+	uart.host_queue.push_back(data);
+
+	if((uart.host_byte_at == SIM_NEVER) && !uart.host_paused) uart.host_byte_at = now + uart_frame_cycles();
+}
+
+void sim_host_pause(bool paused){
+	uart.host_paused = paused;
+
+	if(!paused && (uart.host_byte_at == SIM_NEVER) && !uart.host_queue.empty()) uart.host_byte_at = now + uart_frame_cycles();
+}
+
+static void uart_host_byte_arrived(){
+	uint8_t data = uart.host_queue.front();
+	uart.host_queue.pop_front();
+	last_activity = now;
+
+	if(!(regs[SIM_UCSR0B] & (1 << RXEN0))){
+		uart.rx_disabled++;
+	}
+	else if(uart.rx_count >= sizeof(uart.rx_fifo)){
+		// Third byte finished shifting in while the two level receive FIFO was still full
+		uart.overrun = true;
+		uart.overruns++;
+	}
+	else{
+		uart.rx_fifo[uart.rx_count++] = data;
+		uart.bytes_in++;
+	}
+
+	uart.host_byte_at = (uart.host_queue.empty() || uart.host_paused) ? SIM_NEVER : now + uart_frame_cycles();
+}
+
+static void uart_shift_out(uint8_t data){
+	uart.shift_busy = true;
+	uart.shift_data = data;
+	uart.shift_done = now + uart_frame_cycles();
+	uart.tx_active_cycles += uart_frame_cycles();
+}
+
+static void uart_shift_complete(){
+	last_activity = now;
+	uart.bytes_out++;
+	uart.shift_done = SIM_NEVER;
+
+	if(host) host->receive(uart.shift_data);
+
+	if(uart.buffer_full){
+		uart.buffer_full = false;
+		uart_shift_out(uart.buffer_data);
+	}
+	else{
+		uart.shift_busy = false;
+		uart.tx_complete = true;
+	}
+}
+
+static void uart_write_data(uint8_t data){
+	if(!(regs[SIM_UCSR0B] & (1 << TXEN0))) return;
+
+	if(!uart.shift_busy){
+		uart_shift_out(data);
+	}
+	else if(!uart.buffer_full){
+		uart.buffer_full = true;
+		uart.buffer_data = data;
+	}
+	else{
+		uart.tx_dropped++;
+	}
+}
+
+static uint8_t uart_read_data(){
+	uint8_t data = 0;
+
+	if(uart.rx_count){
+		data = uart.rx_fifo[0];
+		uart.rx_fifo[0] = uart.rx_fifo[1];
+		uart.rx_count--;
+	}
+	uart.overrun = false;
+
+	return data;
+}
+
+static uint8_t uart_status(){
+	return ((uart.rx_count != 0) << RXC0) | (uart.tx_complete << TXC0) | ((!uart.buffer_full) << UDRE0) |
+		(uart.overrun << DOR0) | (regs[SIM_UCSR0A] & ((1 << U2X0) | (1 << MPCM0)));
+}
+
+/*
+
+TWI
+
+*/
+
+static uint64_t twi_bit_cycles(){
+	static const uint8_t prescaler[4] = {1, 4, 16, 64};
+
+	return 16 + 2 * (uint64_t)regs[SIM_TWBR] * prescaler[regs[SIM_TWSR] & 0x03];
+}
+
+static bool twi_scl_held(){
+	for(SimTarget *target : targets){
+		if(target->holds_scl()) return true;
+	}
+	return false;
+}
+
+static void twi_end_transaction(){
+	if(!twi.bus_owned) return;
+
+	uint64_t busy = now - twi.transaction_start;
+
+	twi.busy_cycles += busy;
+	twi.transactions++;
+	twi.bus_owned = false;
+	twi.target = nullptr;
+
+	sim_log(2, "i2c %s P | busy %.1f us, clocking %.1f us", twi.transaction_trace.c_str(), sim_us(busy), sim_us(twi.transaction_clock));
+}
+
+static void twi_schedule(uint8_t operation, uint64_t clocks, uint32_t stretch_us){
+	uint64_t clock = clocks * twi_bit_cycles();
+	uint64_t stretch = sim_cycles(stretch_us);
+
+	twi.operation = operation;
+	twi.transaction_clock += clock;
+	twi.clock_cycles += clock;
+	twi.stretch_cycles += stretch;
+
+	twi.stretch_from = now + clock;
+	twi.stretch_until = now + clock + stretch;
+
+	// A target holding SCL low stalls every operation until the bus is recovered
+	twi.done_at = twi_scl_held() ? SIM_NEVER : now + clock + stretch;
+}
+
+static void twi_begin(uint8_t control){
+	char text[16];
+
+	if(control & (1 << TWSTO)){
+		twi_schedule(TWI_STOP, 1, 0);
+		return;
+	}
+
+	if(control & (1 << TWSTA)){
+		if(!twi.bus_owned){
+			twi.bus_owned = true;
+			twi.transaction_start = now;
+			twi.transaction_clock = 0;
+			twi.transaction_trace = "S";
+			twi.next_status = 0x08;
+		}
+		else{
+			twi.transaction_trace += " Sr";
+			twi.next_status = 0x10;
+		}
+		twi_schedule(TWI_START, 1, 0);
+		return;
+	}
+
+	uint8_t data = regs[SIM_TWDR];
+	uint32_t stretch = 0;
+	bool ack = false;
+
+	switch(twi.status){
+		case 0x08:
+		case 0x10:
+			twi.target = sim_find_target(data >> 1);
+			ack = (twi.target != nullptr) && twi.target->select(data & 0x01);
+			if(!ack) twi.target = nullptr;
+
+			if(data & 0x01){
+				twi.next_status = ack ? 0x40 : 0x48;
+			}
+			else{
+				twi.next_status = ack ? 0x18 : 0x20;
+			}
+			snprintf(text, sizeof(text), " %02X%c%s", data >> 1, (data & 0x01) ? 'R' : 'W', ack ? "" : "~");
+			twi.transaction_trace += text;
+			twi.nacks += !ack;
+
+			if(twi.target){
+				stretch = twi.target->stretch_us;
+				twi.target->count_byte();
+			}
+			twi_schedule(TWI_ADDRESS, 9, stretch);
+			break;
+
+		case 0x18:
+		case 0x20:
+		case 0x28:
+		case 0x30:
+			ack = (twi.target != nullptr) && twi.target->write(data);
+			twi.next_status = ack ? 0x28 : 0x30;
+
+			snprintf(text, sizeof(text), " %02X%s", data, ack ? "" : "~");
+			twi.transaction_trace += text;
+			twi.nacks += !ack;
+
+			if(twi.target){
+				stretch = twi.target->stretch_us;
+				twi.target->count_byte();
+			}
+			twi_schedule(TWI_WRITE, 9, stretch);
+			break;
+
+		case 0x40:
+		case 0x50:
+			ack = control & (1 << TWEA);
+			twi.next_data = twi.target ? twi.target->read(ack) : 0xFF;
+			twi.next_status = ack ? 0x50 : 0x58;
+
+			snprintf(text, sizeof(text), " [%02X%s]", twi.next_data, ack ? "" : "~");
+			twi.transaction_trace += text;
+
+			if(twi.target){
+				stretch = twi.target->stretch_us;
+				twi.target->count_byte();
+			}
+			twi_schedule(TWI_READ, 9, stretch);
+			break;
+
+		default:
+			// Nothing sensible to do from this state, the peripheral just sits there
+			twi.operation = TWI_IDLE;
+			break;
+	}
+}
+
+static void twi_complete(){
+	last_activity = now;
+	twi.done_at = SIM_NEVER;
+
+	uint8_t operation = twi.operation;
+	twi.operation = TWI_IDLE;
+
+	if(operation == TWI_STOP){
+		regs[SIM_TWCR] &= ~(1 << TWSTO);
+		twi.status = 0xF8;
+
+		if(twi.target) twi.target->stop();
+		twi_end_transaction();
+
+		// A START requested while the STOP was still going out is generated as soon as the bus is free
+		if(twi.start_pending){
+			twi.start_pending = false;
+			twi_begin(1 << TWSTA);
+		}
+		return;
+	}
+
+	if(operation == TWI_READ) regs[SIM_TWDR] = twi.next_data;
+
+	twi.bytes += (operation != TWI_START);
+	twi.status = twi.next_status;
+	regs[SIM_TWCR] |= (1 << TWINT);
+}
+
+static void twi_abort(){
+	twi.operation = TWI_IDLE;
+	twi.start_pending = false;
+	twi.done_at = SIM_NEVER;
+	twi.stretch_until = 0;
+	twi.status = 0xF8;
+	twi.peripheral_resets++;
+
+	for(SimTarget *target : targets) target->stop();
+
+	if(twi.bus_owned) twi.transaction_trace += " <reset>";
+	twi_end_transaction();
+}
+
+static void twi_write_control(uint8_t value){
+	uint8_t previous = regs[SIM_TWCR];
+
+	if(!(value & (1 << TWEN))){
+		if(previous & (1 << TWEN)) twi_abort();
+
+		regs[SIM_TWCR] = value & ~((1 << TWINT) | (1 << TWSTO) | (1 << TWSTA));
+		return;
+	}
+
+	// Writing a zero to TWINT leaves the flag alone, writing a one clears it and starts the next operation
+	regs[SIM_TWCR] = (previous & (1 << TWINT)) | (value & ~(1 << TWINT));
+
+	if(!(value & (1 << TWINT))) return;
+
+	if(twi.operation != TWI_IDLE){
+		if((twi.operation == TWI_STOP) && (value & (1 << TWSTA))) twi.start_pending = true;
+		return;
+	}
+
+	regs[SIM_TWCR] &= ~(1 << TWINT);
+	twi_begin(value);
+}
+
+/*
+
+Timer1
+
+*/
+
+static uint16_t timer_count(){
+	if(!timer.prescale) return timer.stopped_count;
+
+	return (uint16_t)((now - timer.start) / timer.prescale);
+}
+
+// Next cycle at which the count reaches the given value, a full wrap away if it is there already
+static uint64_t timer_reaches(uint16_t value){
+	uint64_t ticks = (uint16_t)(value - timer_count());
+
+	if(ticks == 0) ticks = 0x10000;
+
+	return timer.start + ((now - timer.start) / timer.prescale + ticks) * timer.prescale;
+}
+
+static void timer_schedule(){
+	timer.overflow_at = timer.prescale ? timer_reaches(0) : SIM_NEVER;
+	timer.compare_at = timer.prescale ? timer_reaches(timer.compare) : SIM_NEVER;
+}
+
+static void timer_set_count(uint16_t count){
+	timer.stopped_count = count;
+	timer.start = now - (uint64_t)count * timer.prescale;
+	timer_schedule();
+}
+
+static void timer_write_control(uint8_t value){
+	static const uint32_t prescaler[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+	uint16_t count = timer_count();
+
+	if(value & ((1 << WGM13) | (1 << WGM12))) sim_log(1, "timer1: only normal mode is modelled");
+
+	regs[SIM_TCCR1B] = value;
+	timer.prescale = prescaler[value & 0x07];
+	timer_set_count(count);
+}
+
+static void timer_event(){
+	if(timer.overflow_at <= now) regs[SIM_TIFR1] |= (1 << TOV1);
+	if(timer.compare_at <= now) regs[SIM_TIFR1] |= (1 << OCF1A);
+
+	timer_schedule();
+}
+
+/*
+
+GPIO
+
+*/
+
+static void gpio_write_portc(uint8_t value){
+	uint8_t previous = regs[SIM_PORTC];
+	regs[SIM_PORTC] = value;
+
+	// With the TWI disabled the pins belong to the port, so a rising edge on an output PC5 is an SCL clock for the bus recovery sequence
+	if((regs[SIM_TWCR] & (1 << TWEN)) || !(regs[SIM_DDRC] & (1 << PORTC5))) return;
+
+	if(!(previous & (1 << PORTC5)) && (value & (1 << PORTC5))){
+		for(SimTarget *target : targets) target->scl_pulse();
+	}
+}
+
+static uint8_t gpio_read_pinc(){
+	uint8_t pins = (regs[SIM_PORTC] | ~regs[SIM_DDRC]) & 0x3F;
+
+	if(regs[SIM_TWCR] & (1 << TWEN)) pins |= (1 << PINC5) | (1 << PINC4);
+	if(twi_scl_held() || ((now >= twi.stretch_from) && (now < twi.stretch_until))) pins &= ~(1 << PINC5);
+
+	return pins;
+}
+
+static uint8_t gpio_read_pind(){
+	uint8_t pins = regs[SIM_PORTD] | ~regs[SIM_DDRD];
+
+	if(alert.low) pins &= ~(1 << PIND2);
+
+	return pins;
+}
+
+/*
+
+EEPROM
+
+*/
+
+// Erased cells read back as 0xFF
+static struct{
+	uint8_t memory[E2END + 1];
+	bool initialized;
+
+	// Statistics
+	uint64_t bytes_written;
+} eeprom;
+
+static uint8_t *eeprom_cell(uintptr_t address){
+	if(!eeprom.initialized){
+		std::fill(eeprom.memory, eeprom.memory + sizeof(eeprom.memory), 0xFF);
+		eeprom.initialized = true;
+	}
+
+	return &eeprom.memory[address & E2END];
+}
+
+void sim_eeprom_preload(uint16_t address, uint8_t value){
+	*eeprom_cell(address) = value;
+}
+
+uint8_t eeprom_read_byte(const uint8_t *address){
+	tick(sim_config.io_cycles);
+
+	return *eeprom_cell((uintptr_t)address);
+}
+
+void eeprom_read_block(void *destination, const void *source, size_t length){
+	for(size_t index = 0; index < length; index++) ((uint8_t *)destination)[index] = eeprom_read_byte((const uint8_t *)source + index);
+}
+
+void eeprom_update_byte(uint8_t *address, uint8_t value){
+	uint8_t *cell = eeprom_cell((uintptr_t)address);
+
+	tick(sim_config.io_cycles);
+	if(*cell == value) return;
+
+	// Interrupts keep being served while the CPU spins on EEPE
+	sim_delay_us(SIM_EEPROM_WRITE_US);
+	*cell = value;
+	eeprom.bytes_written++;
+}
+
+void eeprom_update_block(const void *source, void *destination, size_t length){
+	for(size_t index = 0; index < length; index++) eeprom_update_byte((uint8_t *)destination + index, ((const uint8_t *)source)[index]);
+}
+
+/*
+
+Event loop
+
+*/
+
+static uint64_t next_event(){
+	uint64_t next = std::min({twi.done_at, uart.shift_done, uart.host_byte_at, timer.overflow_at, timer.compare_at});
+
+	if(host) next = std::min(next, host->wakeup());
+
+	return next;
+}
+
+static bool quiescent(){
+	return (host == nullptr || host->done()) && uart.host_queue.empty() && !uart.shift_busy && (twi.operation == TWI_IDLE);
+}
+
+// The run ends after the host has been done and everything has been quiet for a while, or at the time limit
+static uint64_t run_end(){
+	uint64_t end = sim_cycles(sim_config.limit_us);
+
+	if(quiescent()) end = std::min(end, last_activity + sim_cycles(sim_config.idle_us));
+
+	return end;
+}
+
+static void check_end(){
+	if(now >= sim_cycles(sim_config.limit_us)) sim_finish("time limit");
+
+	if(quiescent() && (now - last_activity >= sim_cycles(sim_config.idle_us))) sim_finish("idle");
+}
+
+static void advance_to(uint64_t target){
+	uint64_t next;
+
+	// Events nobody is waiting for, like timer overflows, must not carry the run past its end
+	while((next = std::min(next_event(), run_end())) <= target){
+		if(next > now) now = next;
+
+		check_end();
+
+		if(twi.done_at <= now) twi_complete();
+		if(uart.shift_done <= now) uart_shift_complete();
+		if(uart.host_byte_at <= now) uart_host_byte_arrived();
+		if(std::min(timer.overflow_at, timer.compare_at) <= now) timer_event();
+		if(host && host->wakeup() <= now){
+			last_activity = now;
+			host->run();
+		}
+	}
+
+	if(target > now) now = target;
+
+	check_end();
+}
+
+static void tick(uint64_t cycles){
+	advance_to(now + cycles);
+}
+
+static bool interrupt_pending(){
+	uint8_t control = regs[SIM_UCSR0B];
+	uint8_t timer_flags = regs[SIM_TIMSK1] & regs[SIM_TIFR1];
+
+	return ((regs[SIM_PCICR] & regs[SIM_PCIFR] & (1 << PCIF2)) && sim_vector_PCINT2) ||
+		((timer_flags & (1 << OCF1A)) && sim_vector_TIMER1_COMPA) ||
+		((timer_flags & (1 << TOV1)) && sim_vector_TIMER1_OVF) ||
+		((control & (1 << RXCIE0)) && uart.rx_count && sim_vector_USART_RX) ||
+		((control & (1 << UDRIE0)) && !uart.buffer_full && sim_vector_USART_UDRE) ||
+		((control & (1 << TXCIE0)) && uart.tx_complete && sim_vector_USART_TX) ||
+		((regs[SIM_TWCR] & ((1 << TWIE) | (1 << TWINT))) == ((1 << TWIE) | (1 << TWINT)) && sim_vector_TWI);
+}
+
+static void run_isr(void (*handler)(void)){
+	in_isr = true;
+	regs[SIM_SREG] &= ~(1 << SREG_I);
+	tick(SIM_ISR_CYCLES);
+
+	handler();
+
+	regs[SIM_SREG] |= (1 << SREG_I);
+	in_isr = false;
+}
+
+static void dispatch_interrupts(){
+	while(!in_isr && (regs[SIM_SREG] & (1 << SREG_I)) && interrupt_pending()){
+		uint8_t control = regs[SIM_UCSR0B];
+		uint8_t timer_flags = regs[SIM_TIMSK1] & regs[SIM_TIFR1];
+
+		// Lower vector number wins, like the hardware priority encoder. Taking a timer or pin change vector clears its flag.
+		if((regs[SIM_PCICR] & regs[SIM_PCIFR] & (1 << PCIF2)) && sim_vector_PCINT2){
+			regs[SIM_PCIFR] &= ~(1 << PCIF2);
+			run_isr(sim_vector_PCINT2);
+		}
+		else if((timer_flags & (1 << OCF1A)) && sim_vector_TIMER1_COMPA){
+			regs[SIM_TIFR1] &= ~(1 << OCF1A);
+			run_isr(sim_vector_TIMER1_COMPA);
+		}
+		else if((timer_flags & (1 << TOV1)) && sim_vector_TIMER1_OVF){
+			regs[SIM_TIFR1] &= ~(1 << TOV1);
+			run_isr(sim_vector_TIMER1_OVF);
+		}
+		else if((control & (1 << RXCIE0)) && uart.rx_count && sim_vector_USART_RX){
+			run_isr(sim_vector_USART_RX);
+		}
+		else if((control & (1 << UDRIE0)) && !uart.buffer_full && sim_vector_USART_UDRE){
+			run_isr(sim_vector_USART_UDRE);
+		}
+		else if((control & (1 << TXCIE0)) && uart.tx_complete && sim_vector_USART_TX){
+			uart.tx_complete = false;
+			run_isr(sim_vector_USART_TX);
+		}
+		else{
+			run_isr(sim_vector_TWI);
+		}
+	}
+}
+
+/*
+
+Register access
+
+*/
+
+uint8_t sim_io_read(uint8_t reg){
+	uint8_t value;
+
+	tick(sim_config.io_cycles);
+
+	switch(reg){
+		case SIM_PINC:		value = gpio_read_pinc(); break;
+		case SIM_PIND:		value = gpio_read_pind(); break;
+		case SIM_TWSR:		value = twi.status | (regs[SIM_TWSR] & 0x03); break;
+		case SIM_UCSR0A:	value = uart_status(); break;
+		case SIM_UDR0:		value = uart_read_data(); break;
+		default:		value = regs[reg]; break;
+	}
+
+	dispatch_interrupts();
+	return value;
+}
+
+void sim_io_write(uint8_t reg, uint8_t value){
+	tick(sim_config.io_cycles);
+
+	switch(reg){
+		case SIM_PORTC:
+			gpio_write_portc(value);
+			break;
+
+		case SIM_TWSR:
+			// Only the prescaler bits are writable
+			regs[SIM_TWSR] = value & 0x03;
+			break;
+
+		case SIM_TWCR:
+			twi_write_control(value);
+			break;
+
+		case SIM_TCCR1B:
+			timer_write_control(value);
+			break;
+
+		case SIM_TIFR1:
+		case SIM_PCIFR:
+			// Flags are cleared by writing a one to them
+			regs[reg] &= ~value;
+			break;
+
+		case SIM_UCSR0A:
+			if(value & (1 << TXC0)) uart.tx_complete = false;
+			regs[SIM_UCSR0A] = value & ((1 << U2X0) | (1 << MPCM0));
+			break;
+
+		case SIM_UDR0:
+			uart_write_data(value);
+			break;
+
+		default:
+			regs[reg] = value;
+			break;
+	}
+
+	dispatch_interrupts();
+}
+
+uint16_t sim_io_read16(uint8_t reg){
+	uint16_t value;
+
+	// Low byte then high byte through TEMP
+	tick(2 * sim_config.io_cycles);
+
+	value = (reg == SIM_TCNT1) ? timer_count() : timer.compare;
+
+	dispatch_interrupts();
+	return value;
+}
+
+void sim_io_write16(uint8_t reg, uint16_t value){
+	tick(2 * sim_config.io_cycles);
+
+	if(reg == SIM_TCNT1){
+		timer_set_count(value);
+	}
+	else{
+		timer.compare = value;
+		timer_schedule();
+	}
+
+	dispatch_interrupts();
+}
+
+// Like the hardware, the instruction after sei always runs before a pending interrupt is taken, which keeps the sei/sleep idiom race free
+void sim_sei(void){
+	tick(1);
+	regs[SIM_SREG] |= (1 << SREG_I);
+}
+
+void sim_cli(void){
+	tick(1);
+	regs[SIM_SREG] &= ~(1 << SREG_I);
+}
+
+void sim_sleep(void){
+	// If nothing will ever raise an interrupt, this jumps straight to the point where the run ends
+	if(!interrupt_pending()) advance_to(std::max(std::min(next_event(), run_end()), now + 1));
+	dispatch_interrupts();
+}
+
+void sim_delay_us(double us){
+	uint64_t end = now + sim_cycles(us);
+
+	// Busy wait loops are still interrupted, so hand out interrupts as the events that raise them come due
+	while(now < end){
+		advance_to(std::min(end, std::max(now + 1, next_event())));
+		dispatch_interrupts();
+	}
+}
+
+/*
+
+Report
+
+*/
+
+[[noreturn]] void sim_finish(const char *reason){
+	uint64_t bit = twi_bit_cycles();
+	uint64_t frame = uart_frame_cycles();
+	uint64_t clocking = twi.clock_cycles + twi.stretch_cycles;
+	int failures = host ? host->failures() : 0;
+
+	printf("\n== simulation report ==\n");
+	printf("  finished     : %s after %.3f ms (%llu cycles at %lu MHz)\n", reason, sim_us(now) / 1000.0, (unsigned long long)now, (unsigned long)(F_CPU / 1000000UL));
+	printf("  serial link  : %.0f baud, %llu bytes in, %llu bytes out, %.1f us per byte\n", (double)F_CPU * 10.0 / (double)frame,
+		(unsigned long long)uart.bytes_in, (unsigned long long)uart.bytes_out, sim_us(frame));
+	printf("  serial loss  : %llu rx overruns, %llu rx while disabled, %llu tx dropped\n", (unsigned long long)uart.overruns,
+		(unsigned long long)uart.rx_disabled, (unsigned long long)uart.tx_dropped);
+	printf("  i2c clock    : %.1f kHz (TWBR=%u, TWPS=%u), %.1f us per byte\n", (double)F_CPU / (double)bit / 1000.0, regs[SIM_TWBR],
+		regs[SIM_TWSR] & 0x03, sim_us(9 * bit));
+	printf("  i2c traffic  : %llu transactions, %llu bytes, %llu nacks, %llu peripheral resets\n", (unsigned long long)twi.transactions,
+		(unsigned long long)twi.bytes, (unsigned long long)twi.nacks, (unsigned long long)twi.peripheral_resets);
+	printf("  i2c bus time : %.1f us owned, %.1f us clocking, %.1f us stretched, %.1f%% of owned time spent clocking\n", sim_us(twi.busy_cycles),
+		sim_us(twi.clock_cycles), sim_us(twi.stretch_cycles), twi.busy_cycles ? 100.0 * (double)clocking / (double)twi.busy_cycles : 0.0);
+	printf("  portb        : 0x%02X\n", regs[SIM_PORTB]);
+	printf("  eeprom       : %llu bytes written\n", (unsigned long long)eeprom.bytes_written);
+	printf("  smbalert     : asserted %llu times, %s at the end\n", (unsigned long long)alert.assertions, alert.low ? "low" : "high");
+
+	if(host) host->report();
+
+	fflush(stdout);
+	exit(failures ? 1 : 0);
+}
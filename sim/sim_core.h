@@ -0,0 +1,75 @@
+/*
+ * sim_core.h
+ *
+ * Host model of the ATmega328P peripherals used by the bridge (TWI, USART0, Timer1, PORTB/PORTC, the PD2 pin change, EEPROM) with cycle accounting.
+ * All time is kept in CPU cycles at F_CPU; peripheral transfers take the time the configured TWBR/TWPS and UBRR0/U2X0 would give on silicon.
+ */
+
+#ifndef SIM_CORE_H_
+#define SIM_CORE_H_
+
+#include <stdint.h>
+
+#define SIM_NEVER	UINT64_MAX
+#define SIM_ALERT_RESPONSE_ADDRESS	0x0C	// SMBus Alert Response Address
+
+class SimTarget;
+
+// The PC side of the serial link
+class SimHost{
+public:
+	virtual ~SimHost() {}
+
+	// A byte sent by the bridge finished arriving at the host
+	virtual void receive(uint8_t data) = 0;
+
+	// Next time the host wants to run, SIM_NEVER if it is blocked on the bridge
+	virtual uint64_t wakeup() const = 0;
+
+	virtual void run() = 0;
+
+	// True once the host has nothing left to send or wait for
+	virtual bool done() const = 0;
+
+	virtual void report() = 0;
+
+	virtual int failures() const = 0;
+};
+
+struct SimConfig{
+	uint32_t io_cycles = 4;			// CPU cycles charged per register access, covering the surrounding load/test/branch
+	uint64_t limit_us = 1000000;		// Hard stop for the simulated run
+	uint64_t idle_us = 20000;		// Quiet time after the host is done before the run ends
+	int verbosity = 1;
+};
+
+extern SimConfig sim_config;
+
+uint64_t sim_now();
+double sim_us(uint64_t cycles);
+uint64_t sim_cycles(double us);
+
+void sim_attach_host(SimHost *host);
+void sim_attach_target(SimTarget *target);
+SimTarget *sim_find_target(uint8_t address);
+
+// SMBALERT# on PD2 is low while any attached target is alerting, call after changing one so the pin change is seen
+void sim_alert_update();
+
+// Alerting target that wins an Alert Response Address read, nullptr if none of them answers it
+SimTarget *sim_alerting_target();
+
+// Set an EEPROM byte as if it had been programmed before power up
+void sim_eeprom_preload(uint16_t address, uint8_t value);
+
+// Queue a byte on the host to bridge direction of the serial link
+void sim_host_transmit(uint8_t data);
+
+// Software flow control from the bridge, a paused host finishes the byte it is sending and then holds the rest
+void sim_host_pause(bool paused);
+
+void sim_log(int level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+[[noreturn]] void sim_finish(const char *reason);
+
+#endif /* SIM_CORE_H_ */
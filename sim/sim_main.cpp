@@ -0,0 +1,491 @@
+/*
+ * sim_main.cpp
+ *
+ * Runs the bridge firmware against a scenario file describing the virtual bus and the host's side of the serial conversation.
+ *
+ *	target <addr> <type> [key=value ...]	Attach a virtual target (types: regs, pmbus, eeprom; ara=0 keeps it out of Alert Response Address reads)
+ *	poke <addr> <reg> <byte> [byte ...]	Set a target's registers, or a pmbus target's response to a command code, in script order so it can change while the bridge works
+ *	eeprom <offset> <byte> [byte ...]	Program the ATmega328P's own EEPROM before the firmware boots
+ *	alert <addr> [0|1]			Target starts pulling SMBALERT# low, or lets go of it with 0, in script order
+ *	absent <addr> [0|1]			Target stops answering its address, or answers again with 0, in script order
+ *	send <text>				Host sends a command line, a newline is appended
+ *	sendhex <byte> [byte ...]		Host sends raw bytes
+ *	frame <byte> [byte ...]			Host sends a binary request frame with the given payload, adding sync, length and CRC
+ *	binary					Host parses responses as binary frames, each one becomes a line of hex payload bytes
+ *	ascii					Host parses responses as newline terminated text again
+ *	expect <text>				Host waits for the next response line and compares it
+ *	match <pattern>				Like expect, but * in the pattern matches any run of characters and ? any one character
+ *	wait <us>				Host stays quiet for a while
+ *	timeout <us>				How long an expect waits for its line (default 100000)
+ *	limit <ms>				Maximum simulated run time (default 1000)
+ *	cpu <cycles>				CPU cycles charged per register access (default 4)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "sim_core.h"
+#include "sim_targets.h"
+
+int firmware_main(void);
+
+enum SIM_STEPS{
+	STEP_SEND,
+	STEP_SENDHEX,
+	STEP_FRAME,
+	STEP_BINARY,
+	STEP_ASCII,
+	STEP_EXPECT,
+	STEP_MATCH,
+	STEP_WAIT,
+	STEP_POKE,
+	STEP_ALERT,
+	STEP_ABSENT
+};
+
+#define FRAME_SYNC	0xA5
+
+struct SimStep{
+	uint8_t kind;
+	std::string text;
+	uint64_t value;
+	int line;
+};
+
+struct SimExpectation{
+	std::string text;
+	uint64_t sent_at;
+	uint64_t received_at;
+	bool passed;
+};
+
+static std::string printable(const std::string &text){
+	std::string result;
+	char hex[8];
+
+	for(unsigned char c : text){
+		if((c >= 0x20) && (c < 0x7F)){
+			result += (char)c;
+		}
+		else{
+			snprintf(hex, sizeof(hex), "\\x%02X", c);
+			result += hex;
+		}
+	}
+	return result;
+}
+
+static bool glob_match(const char *pattern, const char *text){
+	if(*pattern == '\0') return *text == '\0';
+	if(*pattern == '*') return glob_match(pattern + 1, text) || ((*text != '\0') && glob_match(pattern, text + 1));
+	if(*text == '\0') return false;
+
+	return ((*pattern == '?') || (*pattern == *text)) && glob_match(pattern + 1, text + 1);
+}
+
+static std::string hex_string(const std::string &bytes){
+	std::string result;
+	char hex[4];
+
+	for(unsigned char c : bytes){
+		snprintf(hex, sizeof(hex), "%s%02X", result.empty() ? "" : " ", c);
+		result += hex;
+	}
+	return result;
+}
+
+// Written independently of the firmware's copy so a bug in one does not hide in both
+static uint8_t crc8(const std::string &bytes){
+	uint8_t crc = 0;
+
+	for(unsigned char c : bytes){
+		crc ^= c;
+		for(int bit = 0; bit < 8; bit++) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+	}
+	return crc;
+}
+
+class ScriptHost : public SimHost{
+public:
+	std::string path;
+	std::vector<SimStep> steps;
+	uint64_t expect_timeout_us = 100000;
+
+	void receive(uint8_t data) override{
+		if(binary){
+			receive_frame(data);
+			return;
+		}
+		// Text mode honours XON/XOFF like a terminal with software flow control turned on
+		if((data == 0x11) || (data == 0x13)){
+			sim_log(2, "host < %s", (data == 0x13) ? "XOFF" : "XON");
+			if(data == 0x13) pauses++;
+			sim_host_pause(data == 0x13);
+			return;
+		}
+		if(data != '\n'){
+			partial += (char)data;
+			return;
+		}
+		deliver(partial);
+		partial.clear();
+	}
+
+	uint64_t wakeup() const override{
+		return wake_at;
+	}
+
+	void run() override{
+		wake_at = SIM_NEVER;
+
+		while(position < steps.size()){
+			const SimStep &step = steps[position];
+
+			if(step.kind == STEP_SEND){
+				sim_log(1, "host > %s", step.text.c_str());
+				for(char c : step.text) sim_host_transmit((uint8_t)c);
+				sim_host_transmit('\n');
+				last_send = sim_now();
+				sends++;
+			}
+			else if((step.kind == STEP_SENDHEX) || (step.kind == STEP_FRAME)){
+				std::string bytes = step.text;
+
+				if(step.kind == STEP_FRAME){
+					bytes.insert(bytes.begin(), (char)step.text.size());
+					bytes += (char)crc8(bytes);
+					bytes.insert(bytes.begin(), (char)FRAME_SYNC);
+				}
+				sim_log(1, "host > %s", hex_string(bytes).c_str());
+				for(char c : bytes) sim_host_transmit((uint8_t)c);
+				last_send = sim_now();
+				sends++;
+			}
+			else if((step.kind == STEP_BINARY) || (step.kind == STEP_ASCII)){
+				binary = (step.kind == STEP_BINARY);
+				partial.clear();
+			}
+			else if(step.kind == STEP_POKE){
+				poke(step);
+			}
+			else if(step.kind == STEP_ALERT){
+				sim_find_target((uint8_t)step.value)->alerting = (step.text != "0");
+				sim_alert_update();
+			}
+			else if(step.kind == STEP_ABSENT){
+				sim_find_target((uint8_t)step.value)->absent = (step.text != "0");
+			}
+			else if(step.kind == STEP_WAIT){
+				if(!waiting){
+					waiting = true;
+					wait_until = sim_now() + sim_cycles((double)step.value);
+				}
+				if(sim_now() < wait_until){
+					wake_at = wait_until;
+					return;
+				}
+			}
+			else if(!expect(step)){
+				return;
+			}
+
+			waiting = false;
+			position++;
+		}
+	}
+
+	// The step text holds the address, the register and the bytes
+	void poke(const SimStep &step){
+		SimTarget *target = sim_find_target((uint8_t)step.text[0]);
+		SimRegisterTarget *registers = dynamic_cast<SimRegisterTarget *>(target);
+		SimPmbusTarget *pmbus = dynamic_cast<SimPmbusTarget *>(target);
+		uint8_t pointer = (uint8_t)step.text[1];
+
+		if(registers){
+			for(size_t index = 2; index < step.text.size(); index++) registers->memory[pointer++] = (uint8_t)step.text[index];
+		}
+		else if(pmbus){
+			pmbus->commands[pointer].assign(step.text.begin() + 2, step.text.end());
+		}
+	}
+
+	bool done() const override{
+		return position >= steps.size();
+	}
+
+	int failures() const override{
+		int failed = 0;
+
+		for(const SimExpectation &expectation : expectations) failed += !expectation.passed;
+		return failed;
+	}
+
+	void report() override{
+		uint64_t total = 0;
+		uint64_t worst = 0;
+		unsigned answered = 0;
+
+		printf("  commands     : %u sent, %zu expectations, %d failed\n", sends, expectations.size(), failures());
+		if(pauses) printf("  flow control : host paused %u times by XOFF\n", pauses);
+
+		for(const SimExpectation &expectation : expectations){
+			if(expectation.received_at == SIM_NEVER) continue;
+
+			uint64_t latency = expectation.received_at - expectation.sent_at;
+			total += latency;
+			if(latency > worst) worst = latency;
+			answered++;
+		}
+		if(answered){
+			printf("  latency      : %.1f us mean, %.1f us worst from command sent to response line received\n", sim_us(total / answered), sim_us(worst));
+		}
+	}
+
+private:
+	size_t position = 0;
+	bool binary = false;
+	bool in_frame = false;
+	bool waiting = false;
+	uint64_t wake_at = sim_cycles(100);	// Host starts talking shortly after the bridge comes out of reset
+	uint64_t wait_until = 0;
+	uint64_t expect_deadline = 0;
+	uint64_t last_send = 0;
+	unsigned sends = 0;
+	unsigned pauses = 0;
+	std::string partial;
+	std::deque<std::string> lines;
+	std::deque<uint64_t> line_times;
+	std::vector<SimExpectation> expectations;
+
+	void deliver(const std::string &line){
+		sim_log(1, "host < %s", printable(line).c_str());
+		lines.push_back(line);
+		line_times.push_back(sim_now());
+
+		if(waiting) wake_at = sim_now();
+	}
+
+	// partial holds the frame from its length byte onwards
+	void receive_frame(uint8_t data){
+		if(partial.empty() && !in_frame){
+			in_frame = (data == FRAME_SYNC);
+			if(!in_frame) sim_log(1, "host < stray byte %02X between frames", data);
+			return;
+		}
+
+		partial += (char)data;
+		if(partial.size() < (size_t)(uint8_t)partial[0] + 2) return;
+
+		std::string payload = partial.substr(1, partial.size() - 2);
+		bool valid = (crc8(partial.substr(0, partial.size() - 1)) == (uint8_t)partial.back());
+
+		partial.clear();
+		in_frame = false;
+		deliver(valid ? hex_string(payload) : hex_string(payload) + " CRC?");
+	}
+
+	bool expect(const SimStep &step){
+		if(lines.empty()){
+			if(!waiting){
+				waiting = true;
+				expect_deadline = sim_now() + sim_cycles((double)expect_timeout_us);
+			}
+			if(sim_now() < expect_deadline){
+				wake_at = expect_deadline;
+				return false;
+			}
+
+			printf("%s:%d: expected \"%s\" but no response arrived\n", path.c_str(), step.line, step.text.c_str());
+			expectations.push_back({step.text, last_send, SIM_NEVER, false});
+			return true;
+		}
+
+		bool passed = (step.kind == STEP_MATCH) ? glob_match(step.text.c_str(), lines.front().c_str()) : (lines.front() == step.text);
+		SimExpectation expectation = {step.text, last_send, line_times.front(), passed};
+		if(!expectation.passed){
+			printf("%s:%d: expected \"%s\" but got \"%s\"\n", path.c_str(), step.line, step.text.c_str(), printable(lines.front()).c_str());
+		}
+		expectations.push_back(expectation);
+
+		lines.pop_front();
+		line_times.pop_front();
+		return true;
+	}
+};
+
+static ScriptHost script;
+
+static bool parse_scenario(const char *path){
+	std::ifstream file(path);
+	std::string line;
+	int number = 0;
+
+	if(!file){
+		fprintf(stderr, "cannot open %s\n", path);
+		return false;
+	}
+
+	while(std::getline(file, line)){
+		number++;
+
+		if(!line.empty() && (line.back() == '\r')) line.pop_back();
+
+		std::istringstream words(line);
+		std::string command;
+		if(!(words >> command) || (command[0] == '#')) continue;
+
+		size_t offset = line.find_first_not_of(" \t", line.find(command) + command.size());
+		std::string rest = (offset == std::string::npos) ? "" : line.substr(offset);
+
+		if(command == "target"){
+			std::string address;
+			std::string type;
+			std::string option;
+			words >> address >> type;
+
+			SimTarget *target = sim_target_create(type, (uint8_t)strtoul(address.c_str(), nullptr, 0));
+			if(!target){
+				fprintf(stderr, "%s:%d: unknown target type \"%s\"\n", path, number, type.c_str());
+				return false;
+			}
+			while(words >> option){
+				size_t equals = option.find('=');
+				std::string key = option.substr(0, equals);
+				std::string value = (equals == std::string::npos) ? "1" : option.substr(equals + 1);
+
+				if(!target->option(key, value)){
+					fprintf(stderr, "%s:%d: unknown target option \"%s\"\n", path, number, key.c_str());
+					return false;
+				}
+			}
+			sim_attach_target(target);
+		}
+		else if(command == "poke"){
+			std::string address;
+			std::string reg;
+			std::string value;
+			words >> address >> reg;
+
+			SimTarget *target = sim_find_target((uint8_t)strtoul(address.c_str(), nullptr, 0));
+			std::string bytes;
+
+			if(!dynamic_cast<SimRegisterTarget *>(target) && !dynamic_cast<SimPmbusTarget *>(target)){
+				fprintf(stderr, "%s:%d: poke needs a regs or pmbus target\n", path, number);
+				return false;
+			}
+
+			bytes += (char)strtoul(address.c_str(), nullptr, 0);
+			bytes += (char)strtoul(reg.c_str(), nullptr, 0);
+			while(words >> value) bytes += (char)strtoul(value.c_str(), nullptr, 0);
+			script.steps.push_back({STEP_POKE, bytes, 0, number});
+		}
+		else if(command == "eeprom"){
+			std::string offset;
+			std::string value;
+			words >> offset;
+
+			uint16_t address = (uint16_t)strtoul(offset.c_str(), nullptr, 0);
+			while(words >> value) sim_eeprom_preload(address++, (uint8_t)strtoul(value.c_str(), nullptr, 0));
+		}
+		else if(command == "alert"){
+			std::string address;
+			std::string state = "1";
+			words >> address >> state;
+
+			SimTarget *target = sim_find_target((uint8_t)strtoul(address.c_str(), nullptr, 0));
+
+			if(!target || (target->address == SIM_ALERT_RESPONSE_ADDRESS)){
+				fprintf(stderr, "%s:%d: alert needs a target\n", path, number);
+				return false;
+			}
+
+			script.steps.push_back({STEP_ALERT, state, target->address, number});
+		}
+		else if(command == "absent"){
+			std::string address;
+			std::string state = "1";
+			words >> address >> state;
+
+			SimTarget *target = sim_find_target((uint8_t)strtoul(address.c_str(), nullptr, 0));
+
+			if(!target){
+				fprintf(stderr, "%s:%d: absent needs a target\n", path, number);
+				return false;
+			}
+
+			script.steps.push_back({STEP_ABSENT, state, target->address, number});
+		}
+		else if(command == "send"){
+			script.steps.push_back({STEP_SEND, rest, 0, number});
+		}
+		else if((command == "sendhex") || (command == "frame")){
+			std::string bytes;
+			std::string value;
+
+			while(words >> value) bytes += (char)strtoul(value.c_str(), nullptr, 16);
+			script.steps.push_back({(uint8_t)((command == "frame") ? STEP_FRAME : STEP_SENDHEX), bytes, 0, number});
+		}
+		else if(command == "binary"){
+			script.steps.push_back({STEP_BINARY, "", 0, number});
+		}
+		else if(command == "ascii"){
+			script.steps.push_back({STEP_ASCII, "", 0, number});
+		}
+		else if((command == "expect") || (command == "match")){
+			script.steps.push_back({(uint8_t)((command == "expect") ? STEP_EXPECT : STEP_MATCH), rest, 0, number});
+		}
+		else if(command == "wait"){
+			script.steps.push_back({STEP_WAIT, "", strtoull(rest.c_str(), nullptr, 0), number});
+		}
+		else if(command == "timeout"){
+			script.expect_timeout_us = strtoull(rest.c_str(), nullptr, 0);
+		}
+		else if(command == "limit"){
+			sim_config.limit_us = strtoull(rest.c_str(), nullptr, 0) * 1000;
+		}
+		else if(command == "cpu"){
+			sim_config.io_cycles = strtoul(rest.c_str(), nullptr, 0);
+		}
+		else{
+			fprintf(stderr, "%s:%d: unknown command \"%s\"\n", path, number, command.c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char **argv){
+	const char *path = nullptr;
+
+	for(int arg = 1; arg < argc; arg++){
+		if(!strcmp(argv[arg], "-q")){
+			sim_config.verbosity = 0;
+		}
+		else if(!strcmp(argv[arg], "-v")){
+			sim_config.verbosity = 2;
+		}
+		else{
+			path = argv[arg];
+		}
+	}
+
+	if(!path){
+		fprintf(stderr, "usage: %s [-q|-v] scenario\n", argv[0]);
+		return 2;
+	}
+
+	script.path = path;
+	if(!parse_scenario(path)) return 2;
+
+	sim_attach_host(&script);
+	firmware_main();
+
+	sim_finish("firmware returned");
+}
@@ -0,0 +1,267 @@
+/*
+ * sim_targets.cpp
+ *
+ * Virtual SMBus targets that can be attached to the simulated bus.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_core.h"
+#include "sim_targets.h"
+
+bool SimTarget::select(bool read){
+	(void)read;
+	return !absent;
+}
+
+void SimTarget::scl_pulse(){
+	if(!hung) return;
+
+	// A hung target lets go once it has been clocked through the rest of its byte
+	if(++recovery_pulses >= 9){
+		hung = false;
+		recovery_pulses = 0;
+	}
+}
+
+void SimTarget::count_byte(){
+	bytes_seen++;
+
+	if((hang_after != 0) && (bytes_seen == hang_after)){
+		hung = true;
+		recovery_pulses = 0;
+	}
+}
+
+bool SimTarget::option(const std::string &key, const std::string &value){
+	if(key == "stretch"){
+		stretch_us = strtoul(value.c_str(), nullptr, 0);
+	}
+	else if(key == "hangafter"){
+		hang_after = strtoul(value.c_str(), nullptr, 0);
+	}
+	else if(key == "absent"){
+		absent = (value != "0");
+	}
+	else if(key == "ara"){
+		answers_ara = (value != "0");
+	}
+	else{
+		return false;
+	}
+	return true;
+}
+
+SimRegisterTarget::SimRegisterTarget(uint8_t address) : SimTarget(address){
+	memset(memory, 0, sizeof(memory));
+}
+
+bool SimRegisterTarget::select(bool read){
+	if(!SimTarget::select(read)) return false;
+
+	pointer_pending = !read;
+	return true;
+}
+
+bool SimRegisterTarget::write(uint8_t data){
+	if(pointer_pending){
+		pointer = data;
+		pointer_pending = false;
+	}
+	else{
+		memory[pointer++] = data;
+	}
+	return true;
+}
+
+uint8_t SimRegisterTarget::read(bool ack){
+	(void)ack;
+	return memory[pointer++];
+}
+
+static uint8_t crc8(uint8_t crc, uint8_t data){
+	crc ^= data;
+	for(int bit = 0; bit < 8; bit++) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+	return crc;
+}
+
+bool SimPmbusTarget::select(bool read){
+	if(!SimTarget::select(read)) return false;
+
+	// The PEC covers every address and data byte since the START, repeated STARTs included
+	crc = crc8(crc, (uint8_t)((address << 1) | read));
+	command_pending = !read;
+	read_index = 0;
+	return true;
+}
+
+bool SimPmbusTarget::write(uint8_t data){
+	if(command_pending){
+		crc = crc8(crc, data);
+		command = data;
+		command_pending = false;
+		written.clear();
+		return true;
+	}
+
+	auto stored = commands.find(command);
+	if((stored != commands.end()) && (written.size() == stored->second.size())){
+		if(data != crc){
+			sim_log(1, "target %02X: PEC %02X on command %02X does not match %02X", address, data, command, crc);
+			pec_failed = true;
+			return false;
+		}
+		return true;
+	}
+
+	crc = crc8(crc, data);
+	written.push_back(data);
+	return true;
+}
+
+uint8_t SimPmbusTarget::read(bool ack){
+	(void)ack;
+	auto stored = commands.find(command);
+	size_t length = (stored == commands.end()) ? 0 : stored->second.size();
+	uint8_t data = 0xFF;
+
+	if(read_index < length){
+		data = stored->second[read_index];
+	}
+	else if(read_index == length){
+		data = bad_pec ? (uint8_t)~crc : crc;
+	}
+	read_index++;
+
+	crc = crc8(crc, data);
+	return data;
+}
+
+void SimPmbusTarget::stop(){
+	if(!written.empty() && !pec_failed) commands[command] = written;
+
+	written.clear();
+	crc = 0;
+	command_pending = false;
+	pec_failed = false;
+}
+
+bool SimPmbusTarget::option(const std::string &key, const std::string &value){
+	if(key == "badpec"){
+		bad_pec = (value != "0");
+		return true;
+	}
+	return SimTarget::option(key, value);
+}
+
+SimEepromTarget::SimEepromTarget(uint8_t address) : SimTarget(address), memory(4096, 0xFF){
+}
+
+bool SimEepromTarget::select(bool read){
+	if(!SimTarget::select(read)) return false;
+
+	if(sim_now() < busy_until) return false;
+
+	// The low address bits of a single address byte part are block select bits
+	if(address_bytes == 1) pointer = (pointer & 0xFF) | ((uint32_t)(address & 0x07) << 8);
+	address_pending = read ? 0 : address_bytes;
+	return true;
+}
+
+bool SimEepromTarget::write(uint8_t data){
+	if(address_pending){
+		if((address_bytes == 2) && (address_pending == 2)){
+			pointer = (uint32_t)data << 8;
+		}
+		else{
+			pointer = (pointer & ~0xFFu) | data;
+		}
+		address_pending--;
+
+		if(address_pending == 0){
+			page_base = pointer - (pointer % page_size);
+			page_offset = pointer % page_size;
+			page_written = 0;
+			pending.clear();
+		}
+		return true;
+	}
+
+	if(++page_written > page_size) wrapped_writes++;
+
+	pending[(page_base + page_offset) % memory.size()] = data;
+	page_offset = (page_offset + 1) % page_size;
+	return true;
+}
+
+uint8_t SimEepromTarget::read(bool ack){
+	(void)ack;
+	uint8_t data = memory[pointer % memory.size()];
+
+	pointer = (pointer + 1) % memory.size();
+	return data;
+}
+
+void SimEepromTarget::stop(){
+	if(pending.empty()) return;
+
+	for(auto &byte : pending) memory[byte.first] = byte.second;
+	pending.clear();
+
+	pages_written++;
+	busy_until = sim_now() + sim_cycles((double)write_cycle_us);
+	sim_log(2, "target %02X: page %04X written, busy for %u us", address, page_base, write_cycle_us);
+	if(wrapped_writes) sim_log(1, "target %02X: page write wrapped past its boundary", address);
+}
+
+bool SimEepromTarget::option(const std::string &key, const std::string &value){
+	if(key == "size"){
+		memory.assign(strtoul(value.c_str(), nullptr, 0), 0xFF);
+	}
+	else if(key == "page"){
+		page_size = strtoul(value.c_str(), nullptr, 0);
+	}
+	else if(key == "addrbytes"){
+		address_bytes = strtoul(value.c_str(), nullptr, 0);
+	}
+	else if(key == "twr"){
+		write_cycle_us = strtoul(value.c_str(), nullptr, 0);
+	}
+	else{
+		return SimTarget::option(key, value);
+	}
+	return true;
+}
+
+SimAlertResponder::SimAlertResponder() : SimTarget(SIM_ALERT_RESPONSE_ADDRESS){
+}
+
+bool SimAlertResponder::select(bool read){
+	return read && (sim_alerting_target() != nullptr);
+}
+
+bool SimAlertResponder::write(uint8_t data){
+	(void)data;
+	return false;
+}
+
+uint8_t SimAlertResponder::read(bool ack){
+	SimTarget *target = sim_alerting_target();
+
+	(void)ack;
+	if(!target) return 0xFF;
+
+	target->alerting = false;
+	sim_alert_update();
+
+	return (uint8_t)(target->address << 1);
+}
+
+SimTarget *sim_target_create(const std::string &type, uint8_t address){
+	if(type == "regs") return new SimRegisterTarget(address);
+	if(type == "pmbus") return new SimPmbusTarget(address);
+	if(type == "eeprom") return new SimEepromTarget(address);
+
+	return nullptr;
+}
@@ -0,0 +1,148 @@
+/*
+ * sim_targets.h
+ *
+ * Virtual SMBus targets that can be attached to the simulated bus.
+ */
+
+#ifndef SIM_TARGETS_H_
+#define SIM_TARGETS_H_
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+class SimTarget{
+public:
+	explicit SimTarget(uint8_t address) : address(address) {}
+	virtual ~SimTarget() {}
+
+	// Called when the target sees its address after a START. Returning false NACKs the address.
+	virtual bool select(bool read);
+
+	// Master wrote a data byte, returning false NACKs it
+	virtual bool write(uint8_t data) = 0;
+
+	// Master clocks a data byte out of the target. ack is what the master will answer with.
+	virtual uint8_t read(bool ack) = 0;
+
+	// STOP or a peripheral reset ended the transfer
+	virtual void stop() {}
+
+	// Extra clock low time the target adds to every byte, in microseconds
+	uint32_t stretch_us = 0;
+
+	// Number of bytes after which the target hangs holding SCL low until it sees 9 clocks
+	uint32_t hang_after = 0;
+
+	// Address is NACK'd when set
+	bool absent = false;
+
+	// Pulling SMBALERT# low until an Alert Response Address read picks this target
+	bool alerting = false;
+
+	// Takes part in Alert Response Address reads, a target that does not keeps the line low until it is told to let go
+	bool answers_ara = true;
+
+	bool holds_scl() const { return hung; }
+	void scl_pulse();
+	void count_byte();
+
+	// Parses one "key=value" option, returns false if the option is unknown
+	virtual bool option(const std::string &key, const std::string &value);
+
+	const uint8_t address;
+
+protected:
+	bool hung = false;
+	uint32_t bytes_seen = 0;
+	uint8_t recovery_pulses = 0;
+};
+
+// Generic register mapped target: the first byte written selects a register and the pointer auto increments on every access
+class SimRegisterTarget : public SimTarget{
+public:
+	explicit SimRegisterTarget(uint8_t address);
+
+	bool select(bool read) override;
+	bool write(uint8_t data) override;
+	uint8_t read(bool ack) override;
+
+	uint8_t memory[256];
+
+private:
+	uint8_t pointer = 0;
+	bool pointer_pending = false;
+};
+
+// SMBus/PMBus style target: the first byte written is a command code, a read returns the bytes stored for that command followed by a PEC.
+// A write longer than the stored value has its extra byte checked as a PEC and NACK'd on a mismatch, a write without one replaces the stored value.
+class SimPmbusTarget : public SimTarget{
+public:
+	explicit SimPmbusTarget(uint8_t address) : SimTarget(address) {}
+
+	bool select(bool read) override;
+	bool write(uint8_t data) override;
+	uint8_t read(bool ack) override;
+	void stop() override;
+	bool option(const std::string &key, const std::string &value) override;
+
+	// Response bytes for each command code, a block command stores its byte count first
+	std::map<uint8_t, std::vector<uint8_t>> commands;
+
+	// Flip the PEC on reads, to test the bridge's check
+	bool bad_pec = false;
+
+private:
+	uint8_t crc = 0;
+	uint8_t command = 0;
+	bool command_pending = false;
+	bool pec_failed = false;
+	std::vector<uint8_t> written;
+	size_t read_index = 0;
+};
+
+// 24Cxx style EEPROM: one or two address bytes set the memory pointer, written bytes fill a page buffer that wraps at the page boundary like the real parts,
+// and the STOP starts a write cycle during which the device NACKs its address. Single address byte parts take the upper address bits from the device address.
+class SimEepromTarget : public SimTarget{
+public:
+	explicit SimEepromTarget(uint8_t address);
+
+	bool select(bool read) override;
+	bool write(uint8_t data) override;
+	uint8_t read(bool ack) override;
+	void stop() override;
+	bool option(const std::string &key, const std::string &value) override;
+
+	std::vector<uint8_t> memory;
+	uint32_t page_size = 32;
+	uint32_t address_bytes = 2;
+	uint32_t write_cycle_us = 5000;
+
+	// Statistics
+	uint32_t pages_written = 0;
+	uint32_t wrapped_writes = 0;	// Page writes that ran over their boundary and wrapped onto their own start
+
+private:
+	uint32_t pointer = 0;
+	uint32_t address_pending = 0;	// Address bytes still to come after SLA+W
+	uint32_t page_base = 0;
+	uint32_t page_offset = 0;	// Where in the page the next written byte goes
+	uint32_t page_written = 0;
+	uint64_t busy_until = 0;
+	std::map<uint32_t, uint8_t> pending;
+};
+
+// Answers reads of the SMBus Alert Response Address with the address of the alerting target that wins the arbitration, which then releases SMBALERT#
+class SimAlertResponder : public SimTarget{
+public:
+	SimAlertResponder();
+
+	bool select(bool read) override;
+	bool write(uint8_t data) override;
+	uint8_t read(bool ack) override;
+};
+
+SimTarget *sim_target_create(const std::string &type, uint8_t address);
+
+#endif /* SIM_TARGETS_H_ */
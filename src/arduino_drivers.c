@@ -11,14 +11,21 @@
 #define F_CPU 16000000UL
 #endif
 
-#define peripheral_timeout F_CPU >> 7
+#define UART_TX_BUFFER_LENGTH 64 // Must be a power of two so the ring indexes can wrap with a mask
+#define UART_RX_BUFFER_LENGTH 128 // Must be a power of two, holds a few command lines while the bus is busy
+#define UART_RX_XOFF_LEVEL 64 // Bytes waiting when flow control asks the host to pause, the rest of the ring covers what it already has in flight
+#define UART_RX_XON_LEVEL 16 // Bytes waiting when the host is let go again
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include <compat/twi.h>
 #include <util/delay.h>
 
 #include "arduino_drivers.h"
 #include "arduino_errors.h"
+#include "stats.h"
+#include "cache.h"
 
 /*
 
@@ -26,7 +33,92 @@ UART peripheral specific low level commands
 
 */
 
+// Transmit ring buffer, filled by UART_transmit() and drained by the data register empty interrupt
+static volatile uint8_t UART_tx_buffer[UART_TX_BUFFER_LENGTH];
+static volatile uint8_t UART_tx_head = 0;
+static volatile uint8_t UART_tx_tail = 0;
+static volatile uint8_t UART_tx_written = 0; // TXC0 only means something once at least one byte has been handed to the peripheral
+
+// Set by UART_mark(), cleared with the time once everything queued before it has been moved out of the buffer
+static volatile uint8_t UART_mark_pending = 0;
+static volatile uint32_t UART_mark_time = 0;
+
+// XON or XOFF waiting to go out ahead of the buffer, 0 when there is none
+static volatile uint8_t UART_flow_send = 0;
+
+// Set by the SMBALERT# pin change interrupt, which wakes UART_wait() just like a received byte
+static volatile uint8_t ALERT_flag = 0;
+
+// Move the oldest buffered byte into UDR0
+static void UART_transmit_next(){
+	// Flow control jumps the queue, the host has to hear it before the receive ring fills
+	if(UART_flow_send){
+		UDR0 = UART_flow_send;
+		UART_flow_send = 0;
+		UCSR0A = (UCSR0A & ((1 << U2X0) | (1 << MPCM0))) | (1 << TXC0);
+		return;
+	}
+	
+	// Nothing left to send, stop interrupting until the next UART_transmit() turns it back on
+	if(UART_tx_head == UART_tx_tail){
+		UCSR0B &= ~(1 << UDRIE0);
+		
+		if(UART_mark_pending){
+			UART_mark_time = TIMER_now();
+			UART_mark_pending = 0;
+		}
+		return;
+	}
+	
+	UDR0 = UART_tx_buffer[UART_tx_tail];
+	UART_tx_tail = (UART_tx_tail + 1) & (UART_TX_BUFFER_LENGTH - 1);
+	
+	// Clear TXC0 so UART_flush() can tell when this byte has left the shift register
+	UCSR0A = (UCSR0A & ((1 << U2X0) | (1 << MPCM0))) | (1 << TXC0);
+}
+
+ISR(USART_UDRE_vect){
+	UART_transmit_next();
+}
+
+// Receive ring buffer, filled by the receive complete interrupt and drained by UART_receive()
+static volatile uint8_t UART_rx_buffer[UART_RX_BUFFER_LENGTH];
+static volatile uint8_t UART_rx_head = 0;
+static volatile uint8_t UART_rx_tail = 0;
+static volatile uint16_t UART_rx_overflows = 0; // Bytes lost because the ring or the hardware FIFO was full
+static volatile uint8_t UART_flow_control = 0; // Hold the host back with XOFF while the ring is filling, see UART_set_flow_control()
+static volatile uint8_t UART_flow_paused = 0; // XOFF has been sent and not yet taken back
+
+ISR(USART_RX_vect){
+	// DOR0 means the hardware FIFO already dropped a byte before this one
+	if(UCSR0A & (1 << DOR0)) UART_rx_overflows++;
+	
+	uint8_t data = UDR0;
+	uint8_t next_head = (UART_rx_head + 1) & (UART_RX_BUFFER_LENGTH - 1);
+	
+	if(next_head == UART_rx_tail){
+		UART_rx_overflows++;
+		return;
+	}
+	
+	UART_rx_buffer[UART_rx_head] = data;
+	UART_rx_head = next_head;
+	
+	if(UART_flow_control && !UART_flow_paused && (((UART_rx_head - UART_rx_tail) & (UART_RX_BUFFER_LENGTH - 1)) >= UART_RX_XOFF_LEVEL)){
+		UART_flow_paused = 1;
+		UART_flow_send = UART_XOFF;
+		UCSR0B |= (1 << UDRIE0);
+	}
+}
+
+// Settings UART_reinit() starts the peripheral over with
+static unsigned long UART_baud = 0;
+static uint8_t UART_double_speed = 0;
+
 uint8_t UART_init(unsigned long baud, uint8_t double_speed){
+	UART_baud = baud;
+	UART_double_speed = double_speed;
+	
 	// Set baud rate using high and low bit
 	UBRR0H = (((F_CPU / (baud * (F_CPU/1000000))) - 1) >> 8);
 	UBRR0L = (((F_CPU / (baud * (F_CPU/1000000))) - 1));
@@ -34,22 +126,55 @@ uint8_t UART_init(unsigned long baud, uint8_t double_speed){
 	// Enable or disable double speed transfers (multiply baud rate by 2)
 	UCSR0A |= (double_speed << U2X0);
 
-	// Enable receive and transmit, then check if they were enabled.
-	UCSR0B |= (1 << RXEN0)|(1 << TXEN0);
+	// Enable receive and transmit, then check if they were enabled. Received bytes are collected by interrupt.
+	UCSR0B |= (1 << RXCIE0)|(1 << RXEN0)|(1 << TXEN0);
 	
 	return ((!(UCSR0B & (1 << RXEN0))) || (!(UCSR0B & (1 << TXEN0)))) ? UART_ENABLE_FAIL : NO_ERROR;
 }
 
+uint8_t UART_reinit(){
+	// Whatever was waiting to go out is dropped, received bytes are kept
+	UCSR0B = 0;
+	UART_tx_tail = UART_tx_head;
+	UART_tx_written = 0;
+	
+	// A pending XON or XOFF is not part of the buffer and still goes out, or the host could be left paused
+	if(UART_init(UART_baud, UART_double_speed) != NO_ERROR) return UART_ENABLE_FAIL;
+	if(UART_flow_send) UCSR0B |= (1 << UDRIE0);
+	
+	return NO_ERROR;
+}
+
 uint8_t UART_transmit(uint8_t data){
 	uint32_t timeout_counter = 0;
+	uint8_t next_head = (UART_tx_head + 1) & (UART_TX_BUFFER_LENGTH - 1);
 	
-	// Wait for transmit buffer to be empty. Then put the new data character into the FIFO buffer.
-	while (!(UCSR0A & (1 << UDRE0)));
+	// Wait for the interrupt to make room in the buffer. With interrupts disabled nothing else will drain it, so move the oldest byte out by hand.
+	while (next_head == UART_tx_tail){
+		if(!(SREG & (1 << SREG_I)) && (UCSR0A & (1 << UDRE0))){
+			UART_transmit_next();
+		}
+		
+		if(timeout_counter >= peripheral_timeout) return UART_TRANSMISSION_TIMEOUT;
+		timeout_counter++;
+	}
+	
+	UART_tx_buffer[UART_tx_head] = data;
+	UART_tx_head = next_head;
+	UART_tx_written = 1;
+	
+	UCSR0B |= (1 << UDRIE0);
+	
+	return NO_ERROR;
+}
+
+uint8_t UART_flush(){
+	uint32_t timeout_counter = 0;
 	
-	UDR0 = data;
+	if(!UART_tx_written) return NO_ERROR;
 	
-	// Wait for the transmission to complete
-	while (!(UCSR0A & (1 << TXC0))){
+	// Wait for the buffer to empty and the last byte to finish shifting out onto the wire
+	while ((UART_tx_head != UART_tx_tail) || !(UCSR0A & (1 << TXC0))){
 		if(timeout_counter >= peripheral_timeout) break;
 		timeout_counter++;
 	}
@@ -57,6 +182,132 @@ uint8_t UART_transmit(uint8_t data){
 	return (timeout_counter >= peripheral_timeout) ? UART_TRANSMISSION_TIMEOUT : NO_ERROR;
 }
 
+uint8_t UART_available(){
+	return (UART_rx_head - UART_rx_tail) & (UART_RX_BUFFER_LENGTH - 1);
+}
+
+uint8_t UART_receive(){
+	uint8_t interrupt_state = SREG;
+	uint8_t data;
+	
+	// Idle until the receive interrupt has something for us. Interrupts are only re-enabled right before sleeping, so a byte arriving after the check still wakes the CPU.
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	cli();
+	while (UART_rx_head == UART_rx_tail){
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+		cli();
+	}
+	
+	data = UART_rx_buffer[UART_rx_tail];
+	UART_rx_tail = (UART_rx_tail + 1) & (UART_RX_BUFFER_LENGTH - 1);
+	
+	if(UART_flow_paused && (((UART_rx_head - UART_rx_tail) & (UART_RX_BUFFER_LENGTH - 1)) <= UART_RX_XON_LEVEL)){
+		UART_flow_paused = 0;
+		UART_flow_send = UART_XON;
+		UCSR0B |= (1 << UDRIE0);
+	}
+	SREG = interrupt_state;
+	
+	return data;
+}
+
+void UART_set_flow_control(uint8_t enabled){
+	uint8_t interrupt_state = SREG;
+	
+	cli();
+	UART_flow_control = enabled;
+	
+	// A host left paused would never send the next command
+	if(!enabled && UART_flow_paused){
+		UART_flow_paused = 0;
+		UART_flow_send = UART_XON;
+		UCSR0B |= (1 << UDRIE0);
+	}
+	SREG = interrupt_state;
+}
+
+uint8_t UART_wait(uint32_t deadline){
+	uint8_t interrupt_state = SREG;
+	
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	cli();
+	
+	// The compare interrupt only matches the low half of the tick count, so it can also wake the CPU early and the caller just asks again.
+	// OCR1A goes through the TEMP register that TIMER_now() in an interrupt also uses, so it is only written with interrupts off.
+	OCR1A = (uint16_t)deadline;
+	TIFR1 = (1 << OCF1A);
+	TIMSK1 |= (1 << OCIE1A);
+	
+	// Same race free idle as UART_receive(), but checked against the deadline after the compare is armed so a match in between is never missed
+	if((UART_rx_head == UART_rx_tail) && !ALERT_flag && ((int32_t)(TIMER_now() - deadline) < 0)){
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+	}
+	SREG = interrupt_state;
+	
+	TIMSK1 &= ~(1 << OCIE1A);
+	
+	return UART_available();
+}
+
+void UART_mark(){
+	uint8_t interrupt_state = SREG;
+	
+	cli();
+	if(UART_tx_head == UART_tx_tail){
+		UART_mark_time = TIMER_now();
+		UART_mark_pending = 0;
+	}
+	else{
+		UART_mark_pending = 1;
+	}
+	SREG = interrupt_state;
+}
+
+uint8_t UART_mark_passed(uint32_t *time){
+	uint8_t interrupt_state = SREG;
+	uint8_t passed;
+	
+	cli();
+	passed = !UART_mark_pending;
+	*time = UART_mark_time;
+	SREG = interrupt_state;
+	
+	return passed;
+}
+
+uint16_t UART_get_rx_overflows(){
+	uint8_t interrupt_state = SREG;
+	uint16_t overflows;
+	
+	cli();
+	overflows = UART_rx_overflows;
+	SREG = interrupt_state;
+	
+	return overflows;
+}
+
+uint8_t UART_transmit_decimal(uint32_t data){
+	uint8_t system_status = NO_ERROR;
+	char digits[10];
+	uint8_t count = 0;
+	
+	// Digits come out least significant first, so they are sent back to front
+	do{
+		digits[count++] = '0' + (data % 10);
+		data /= 10;
+	}while(data);
+	
+	while(count) system_status |= UART_transmit(digits[--count]);
+	
+	return system_status;
+}
+
 uint8_t UART_transmit_hex(uint8_t data){
 	uint8_t system_status = NO_ERROR;
 	
@@ -75,6 +326,13 @@ I2C/SMBus/PMBus peripheral specific low level commands
 
 */
 
+static uint16_t I2C_timeout_ms = I2C_DEFAULT_TIMEOUT_MS; // Longest a single START, byte or STOP may take
+static uint8_t I2C_smbus_timeout = 0; // Also give up once SCL has been held low for tTIMEOUT
+
+// When the bus operation being watched started, and when SCL was last seen high during it
+static uint32_t I2C_operation_start = 0;
+static uint32_t I2C_clock_high_at = 0;
+
 uint8_t I2C_init(){
 	// Setup I2C to start with 100kHz transaction frequency
 	TWSR = ((0 << TWPS0) | (0 << TWPS1));
@@ -86,6 +344,13 @@ uint8_t I2C_init(){
 	return (!(TWCR & (1 << TWEN))) ? I2C_ENABLE_FAIL : NO_ERROR;
 }
 
+// Back to the power on state at 100kHz
+uint8_t I2C_reinit(){
+	TWCR = 0;
+	
+	return I2C_init();
+}
+
 void I2C_start(){
 	TWCR = ((1<<TWINT) | (1<<TWEN) | (1<<TWSTA));
 }
@@ -116,6 +381,9 @@ uint8_t I2C_get_status(){
 }
 
 void I2C_reset_bus(){
+	STATS_count(STATS_BUS_RESETS);
+	CACHE_flush(); // Whatever the slaves were doing, nothing read from them before is trusted
+	
 	// Turn off I2C peripheral and check that it disabled
 	TWCR &= ~(1 << TWEN);
 	
@@ -136,48 +404,71 @@ void I2C_reset_bus(){
 	TWCR |= (1 << TWEN);
 	
 	if (!(TWCR & (1 << TWEN))){
-		system_error_handler(I2C_ENABLE_FAIL);;
+		system_error_handler(I2C_ENABLE_FAIL);
 	}
 }
 
+void I2C_set_timeout(uint16_t milliseconds, uint8_t smbus){
+	if(milliseconds) I2C_timeout_ms = milliseconds;
+	I2C_smbus_timeout = smbus;
+}
+
+uint16_t I2C_get_timeout(uint8_t *smbus){
+	*smbus = I2C_smbus_timeout;
+	
+	return I2C_timeout_ms;
+}
+
+void I2C_operation_begin(){
+	I2C_operation_start = TIMER_now();
+	I2C_clock_high_at = I2C_operation_start;
+}
+
+// Called over and over while waiting on the operation, which is also how SCL gets sampled
+uint8_t I2C_operation_expired(){
+	uint32_t now = TIMER_now();
+	
+	if(PINC & (1 << PINC5)) I2C_clock_high_at = now;
+	
+	if(I2C_smbus_timeout && ((now - I2C_clock_high_at) >= ((uint32_t)I2C_SMBUS_TIMEOUT_MS * TIMER_TICKS_PER_MS))) return 1;
+	
+	return (now - I2C_operation_start) >= ((uint32_t)I2C_timeout_ms * TIMER_TICKS_PER_MS);
+}
+
 uint8_t I2C_timeout(){
-	uint32_t timeout_counter = 0;
 	uint8_t I2C_status = I2C_NO_ERROR;
 	
+	I2C_operation_begin();
+	
 	// Check if TWINT was set to indicate that the last command was completed
 	while(!(TWCR & (1 << TWINT))){
 		
 		// Check if the bus release timeout has elapsed
-		if(timeout_counter >= peripheral_timeout){
+		if(I2C_operation_expired()){
 			I2C_reset_bus();
 			
 			I2C_status = I2C_BUS_RESET;
 			break;
 		}
-		else{
-			timeout_counter++;
-		}
 	}
 	return I2C_status;
 }
 
 uint8_t I2C_release_bus(){
-	uint32_t timeout_counter = 0;
 	uint8_t I2C_status = I2C_NO_ERROR;
 	
-	// A failed command or hung bus will prevent the stop bit from being set
-	while(!(TWCR & (1 << TWSTO))){
+	I2C_operation_begin();
+	
+	// TWSTO clears itself once the STOP is out, a hung bus keeps it set
+	while(TWCR & (1 << TWSTO)){
 		
 		// Check if the bus release timeout has elapsed
-		if(timeout_counter >= peripheral_timeout){
+		if(I2C_operation_expired()){
 			I2C_reset_bus();
 			
 			I2C_status = I2C_BUS_RESET;
 			break;
 		}
-		else{
-			timeout_counter++;
-		}
 	}
 	return I2C_status;
 }
@@ -186,29 +477,150 @@ uint8_t I2C_get_speed(){
 	return TWBR;
 }
 
-uint8_t I2C_set_speed_very_slow(){
-	uint8_t frequency = (((F_CPU/10000)/4)-16)/2;
+// SCL = F_CPU / (16 + 2 * TWBR * 4^TWPS)
+uint32_t I2C_get_frequency(){
+	return F_CPU / (16 + ((2UL * TWBR) << (2 * (TWSR & ((1 << TWPS1) | (1 << TWPS0))))));
+}
+
+// The fastest clock that does not go over the requested one. The smallest prescaler TWBR can reach it with gives the finest steps. Anything below the slowest rate gets the slowest rate.
+uint8_t I2C_set_frequency(uint32_t frequency){
+	uint32_t divider = 0;
+	uint32_t step = 0;
+	uint32_t bit_rate = 0xFF;
+	uint8_t prescaler = 0;
 	
-	TWSR = ((1<<TWPS0) | (0<<TWPS1));
-	TWBR = frequency;
+	if(frequency == 0) frequency = 1;
 	
-	return (I2C_get_speed() != frequency) ? I2C_BAUD_FAIL : NO_ERROR;
+	divider = (F_CPU + frequency - 1) / frequency;
+	if(divider < 16) divider = 16;
+	
+	for(prescaler = 0; prescaler < 4; prescaler++){
+		step = 2UL << (2 * prescaler);
+		
+		if(((divider - 16 + step - 1) / step) <= 0xFF){
+			bit_rate = (divider - 16 + step - 1) / step;
+			break;
+		}
+	}
+	if(prescaler == 4) prescaler = 3;
+	
+	TWSR = prescaler;
+	TWBR = bit_rate;
+	
+	return ((I2C_get_speed() != bit_rate) || ((TWSR & ((1 << TWPS1) | (1 << TWPS0))) != prescaler)) ? I2C_BAUD_FAIL : NO_ERROR;
+}
+
+uint8_t I2C_set_speed_very_slow(){
+	return I2C_set_frequency(10000);
 }
 
 uint8_t I2C_set_speed_standard(){
-	uint8_t frequency = (((F_CPU/100000)/1)-16)/2;
+	return I2C_set_frequency(100000);
+}
+
+uint8_t I2C_set_speed_fast(){
+	return I2C_set_frequency(400000);
+}
+
+/*
+
+Timer1 specific low level commands
+
+*/
+
+static volatile uint16_t TIMER_overflows = 0; // Upper half of the 32 bit tick count
+
+ISR(TIMER1_OVF_vect){
+	TIMER_overflows++;
+}
+
+// Nothing to do, the interrupt is only there to wake the CPU out of UART_wait()
+ISR(TIMER1_COMPA_vect){
+}
+
+uint8_t TIMER_init(){
+	// Normal mode, free running at F_CPU/64 and extended to 32 bits by the overflow interrupt
+	TCCR1A = 0;
+	TCCR1B = ((1 << CS11) | (1 << CS10));
+	TIMSK1 = (1 << TOIE1);
 	
-	TWSR = ((0<<TWPS0) | (0<<TWPS1));
-	TWBR = frequency;
+	return (TCCR1B != ((1 << CS11) | (1 << CS10))) ? TIMER_ENABLE_FAIL : NO_ERROR;
+}
+
+uint32_t TIMER_now(){
+	uint8_t interrupt_state = SREG; // Also called with interrupts already off, which have to stay off
+	uint16_t overflows;
+	uint16_t count;
+	
+	cli();
+	overflows = TIMER_overflows;
+	count = TCNT1;
 	
-	return (I2C_get_speed() != frequency) ? I2C_BAUD_FAIL : NO_ERROR;
+	// An overflow that happened after interrupts were disabled has not been counted yet, a small count means it came before the read
+	if((TIFR1 & (1 << TOV1)) && (count < 0x8000)) overflows++;
+	SREG = interrupt_state;
+	
+	return ((uint32_t)overflows << 16) | count;
 }
 
-uint8_t I2C_set_speed_fast(){
-	uint8_t frequency = (((F_CPU/400000)/1)-16)/2;
+// Received bytes, SMBALERT# and overflows still wake the CPU, which goes straight back to sleep until the deadline instead of spinning on a byte nobody reads yet
+void TIMER_wait(uint32_t deadline){
+	uint8_t interrupt_state = SREG;
 	
-	TWSR = ((0<<TWPS0) | (0<<TWPS1));
-	TWBR = frequency;
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	cli();
 	
-	return (I2C_get_speed() != frequency) ? I2C_BAUD_FAIL : NO_ERROR;
+	// Armed with interrupts off for the same reason as in UART_wait()
+	OCR1A = (uint16_t)deadline;
+	TIFR1 = (1 << OCF1A);
+	TIMSK1 |= (1 << OCIE1A);
+	
+	while((int32_t)(TIMER_now() - deadline) < 0){
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+		cli();
+	}
+	SREG = interrupt_state;
+	
+	TIMSK1 &= ~(1 << OCIE1A);
+}
+
+/*
+
+SMBALERT# pin change specific low level commands
+
+*/
+
+// The line is open drain and wired-AND between devices, so only the falling edge means a device wants attention
+ISR(PCINT2_vect){
+	if(!(PIND & (1 << PIND2))) ALERT_flag = 1;
+}
+
+uint8_t ALERT_init(){
+	DDRD &= ~(1 << PORTD2);
+	PORTD |= (1 << PORTD2);
+	
+	PCMSK2 |= (1 << PCINT18);
+	PCIFR = (1 << PCIF2);
+	PCICR |= (1 << PCIE2);
+	
+	return (PCICR & (1 << PCIE2)) ? NO_ERROR : ALERT_ENABLE_FAIL;
+}
+
+uint8_t ALERT_pending(){
+	uint8_t interrupt_state = SREG;
+	uint8_t pending;
+	
+	cli();
+	pending = ALERT_flag;
+	ALERT_flag = 0;
+	SREG = interrupt_state;
+	
+	return pending;
+}
+
+uint8_t ALERT_asserted(){
+	return !(PIND & (1 << PIND2));
 }
\ No newline at end of file
@@ -11,6 +11,17 @@
 
 #include <avr/io.h>
 
+#define peripheral_timeout F_CPU >> 7 // Polling loop iterations before a peripheral is given up on
+
+#define TIMER_TICK_US 4 // Timer1 runs at F_CPU/64
+#define TIMER_TICKS_PER_MS (F_CPU / 64000)
+
+#define UART_XON 0x11
+#define UART_XOFF 0x13
+
+#define I2C_DEFAULT_TIMEOUT_MS 35 // Per bus operation, about what the old polling loop count came to at 16 MHz
+#define I2C_SMBUS_TIMEOUT_MS 25 // SMBus tTIMEOUT minimum, slaves may reset themselves any time from here to 35 ms
+
 /*
 
 UART specific low level commands
@@ -19,10 +30,30 @@ UART specific low level commands
 
 uint8_t UART_init(unsigned long baud, uint8_t double_speed);
 
+uint8_t UART_reinit();
+
 uint8_t UART_transmit(uint8_t data);
 
+uint8_t UART_flush();
+
+uint8_t UART_available();
+
+uint8_t UART_receive();
+
+void UART_set_flow_control(uint8_t enabled); // Send XOFF when the receive ring is half full and XON once it has drained, for streams that outrun the bus
+
+uint8_t UART_wait(uint32_t deadline); // Idle until a byte arrives, SMBALERT# falls or TIMER_now() reaches deadline, returns UART_available()
+
+void UART_mark(); // Note when everything transmitted so far has left the buffer
+
+uint8_t UART_mark_passed(uint32_t *time); // 1 once the last mark has been passed, with the TIMER_now() it happened at
+
+uint16_t UART_get_rx_overflows();
+
 uint8_t UART_transmit_hex(uint8_t data);
 
+uint8_t UART_transmit_decimal(uint32_t data);
+
 /*
 
 I2C/SMBus specific low level commands
@@ -31,6 +62,8 @@ I2C/SMBus specific low level commands
 
 uint8_t I2C_init();
 
+uint8_t I2C_reinit();
+
 void I2C_start();
 
 void I2C_write(uint8_t data);
@@ -47,16 +80,52 @@ uint8_t I2C_get_status();
 
 void I2C_reset_bus();
 
+void I2C_set_timeout(uint16_t milliseconds, uint8_t smbus); // Deadline for each bus operation (0 = unchanged), and whether SCL held low for tTIMEOUT ends it sooner
+
+uint16_t I2C_get_timeout(uint8_t *smbus);
+
+void I2C_operation_begin(); // Start the clock on a bus operation for I2C_operation_expired()
+
+uint8_t I2C_operation_expired();
+
 uint8_t I2C_timeout();
 
 uint8_t I2C_release_bus();
 
 uint8_t I2C_get_speed();
 
+uint32_t I2C_get_frequency(); // Hz, as set by TWBR and the prescaler
+
+uint8_t I2C_set_frequency(uint32_t frequency); // Hz, rounded down to the nearest rate TWBR and the prescaler can make
+
 uint8_t I2C_set_speed_very_slow(); // 10kHz
 
 uint8_t I2C_set_speed_standard(); // 100kHz
 
 uint8_t I2C_set_speed_fast(); // 400kHz
 
+/*
+
+Timer1 specific low level commands
+
+*/
+
+uint8_t TIMER_init();
+
+uint32_t TIMER_now(); // Ticks of TIMER_TICK_US since TIMER_init(), wraps after about 4.7 hours
+
+void TIMER_wait(uint32_t deadline); // Idle until TIMER_now() reaches deadline, received bytes are left in the buffer
+
+/*
+
+SMBALERT# pin change specific low level commands
+
+*/
+
+uint8_t ALERT_init(); // SMBALERT# on PD2 (Arduino D2) with the internal pull-up
+
+uint8_t ALERT_pending(); // 1 once for every time SMBALERT# has gone low since the last call
+
+uint8_t ALERT_asserted(); // SMBALERT# is low right now
+
 #endif /* ARDUINO_DRIVERS_H_ */
\ No newline at end of file
@@ -15,12 +15,60 @@
 #include <util/delay.h>
 
 #include "arduino_errors.h"
+#include "arduino_drivers.h"
 
-// Force an infinite loop where the on-board LED blinks in accordance to the current error code. The rest of PORTB is used to provide a binary representation of the error code.
+static uint16_t system_fault_counts[SYSTEM_ERROR_CODE_COUNT];
+static uint8_t system_fault_unreported = NO_ERROR; // Last fault recovered from that the host has not been told about
+static uint8_t system_fault_streak = 0; // Faults since the last report got out
+static uint8_t system_recovering = 0;
+
+// Start the peripheral behind a fault over. Returns zero if there is nothing that can be done about it.
+static uint8_t system_recover(uint8_t state){
+	switch(state){
+		case UART_ENABLE_FAIL:
+		case UART_TRANSMISSION_TIMEOUT:
+			return UART_reinit() == NO_ERROR;
+		
+		case I2C_ENABLE_FAIL:
+		case I2C_DISABLE_FAIL:
+		case I2C_BAUD_FAIL:
+			return I2C_reinit() == NO_ERROR;
+		
+		case TIMER_ENABLE_FAIL:
+			return TIMER_init() == NO_ERROR;
+		
+		case ALERT_ENABLE_FAIL:
+			return ALERT_init() == NO_ERROR;
+		
+		case UART_RECEIVE_DATA_OVERFLOW: // The caller throws the line away, nothing is broken
+			return 1;
+		
+		default:
+			return 0;
+	}
+}
+
+// Recover from the fault if possible, otherwise force an infinite loop where the on-board LED blinks in accordance to the current error code. The rest of PORTB is used to provide a binary representation of the error code.
 void system_error_handler(uint8_t state){
 	
 	if(state == NO_ERROR) return;
 	
+	if(state < SYSTEM_ERROR_CODE_COUNT) system_fault_counts[state]++;
+	
+	// A fault while recovering from another one means the hardware is not coming back
+	if(!system_recovering && (++system_fault_streak <= SYSTEM_FAULT_RETRIES)){
+		system_recovering = 1;
+		
+		if(system_recover(state)){
+			system_recovering = 0;
+			system_fault_unreported = state;
+			return;
+		}
+	}
+	
+	// Let anything still queued for the host go out before the board latches
+	UART_flush();
+	
 	PORTB &= ~(1 << PORTB5);
 	
 	PORTB |= state;
@@ -34,4 +82,18 @@ void system_error_handler(uint8_t state){
 		}
 		_delay_ms(1000);
 	}
+}
+
+uint8_t system_fault_pending(){
+	return system_fault_unreported;
+}
+
+// The host knows, so the fault is over and the next one gets its own retries
+void system_fault_reported(){
+	system_fault_unreported = NO_ERROR;
+	system_fault_streak = 0;
+}
+
+uint16_t system_fault_count(uint8_t state){
+	return (state < SYSTEM_ERROR_CODE_COUNT) ? system_fault_counts[state] : 0;
 }
\ No newline at end of file
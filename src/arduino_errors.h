@@ -10,10 +10,13 @@
 #define ARDUINO_ERRORS_H_
 
 /*
-All of these error codes require human intervention if they occur since a power cycle is the only effective method of dealing with them.
+system_error_handler() restarts the peripheral behind any of these error codes, counts it, and leaves it to be reported over serial between command lines.
+Only a fault that cannot be recovered from, or keeps coming back before it can even be reported, latches the board into the blink loop. A power cycle is then the only way out.
 A watchdog timer will not work since it will kill the serial terminal on the PC side (Arduino devices have the reset pin of the USB CDC device connected to the reset pin of the ATMEGA328P).
 */
 
+#define SYSTEM_FAULT_RETRIES 3 // Recoveries in a row without a report getting out before the fault is treated as unrecoverable
+
 enum SYSTEM_ERROR_CODES{
 	NO_ERROR,					// No problems reported
 	UART_ENABLE_FAIL,				// UART peripheral failed to enable properly and remained disabled
@@ -22,7 +25,10 @@ enum SYSTEM_ERROR_CODES{
 	I2C_DISABLE_FAIL,				// I2C peripheral failed to disable properly and remained enabled
 	I2C_BAUD_FAIL,					// I2C peripheral failed to change baud rate register when commanded
 	INCORRECT_GPIO_CONFIGURATION,			// GPIO output register failed to be set to the expected value
-	UART_RECEIVE_DATA_OVERFLOW			// The data received over UART is too big to fit into memory
+	UART_RECEIVE_DATA_OVERFLOW,			// The data received over UART is too big to fit into memory
+	TIMER_ENABLE_FAIL,				// Timer1 failed to start running, so there is no time base for scheduled polls
+	ALERT_ENABLE_FAIL,				// SMBALERT# pin change interrupt failed to enable, so alerts go unnoticed
+	SYSTEM_ERROR_CODE_COUNT
 };
 
 /*
@@ -39,9 +45,15 @@ enum I2C_ERROR_CODES{
 	I2C_DATA_READ_NACK_FAIL				= 0x10,	// A read data byte should have been NACK'd but was not
 	I2C_BUS_RESET					= 0x20,	// A timeout expired and the master needed to pulse SCL to reset the bus
 	I2C_NO_BYTES_REQUESTED				= 0x40,	// Zero bytes were requested from slave device during a read
-	I2C_RESERVED					= 0x80	// Reserved for future use
+	I2C_PEC_FAIL					= 0x80	// PEC read from the slave did not match the CRC-8 of the transaction
 };
 
 void system_error_handler(uint8_t state);
 
+uint8_t system_fault_pending();
+
+void system_fault_reported();
+
+uint16_t system_fault_count(uint8_t state);
+
 #endif /* ARDUINO_ERRORS_H_ */
@@ -0,0 +1,56 @@
+/*
+ * binary_protocol.c
+ *
+ * Created: 10/17/2026 9:41:12 AM
+ *  Author: aparady
+ */ 
+
+#include <avr/io.h>
+
+#include "binary_protocol.h"
+#include "crc8.h"
+#include "arduino_drivers.h"
+#include "arduino_errors.h"
+
+// Wait for a complete request frame and copy its payload out. Returns the payload length, or 0 if the frame was empty or failed its CRC.
+uint8_t BINARY_receive_frame(uint8_t *payload){
+	uint8_t length = 0;
+	uint8_t crc = 0;
+	
+	// Anything before the sync byte is line noise or the rest of the ASCII line that switched modes
+	while(UART_receive() != BINARY_SYNC);
+	
+	length = UART_receive();
+	crc = CRC8_update(crc, length);
+	
+	for(uint8_t payload_index = 0; payload_index < length; payload_index++){
+		payload[payload_index] = UART_receive();
+		crc = CRC8_update(crc, payload[payload_index]);
+	}
+	
+	return (UART_receive() == crc) ? length : 0;
+}
+
+uint8_t BINARY_transmit_frame(uint8_t opcode, uint8_t status, uint8_t *data, uint8_t length){
+	uint8_t system_status = NO_ERROR;
+	uint8_t crc = 0;
+	
+	// Opcode and status come first in every response payload
+	crc = CRC8_update(crc, length + 2);
+	crc = CRC8_update(crc, opcode);
+	crc = CRC8_update(crc, status);
+	
+	system_status |= UART_transmit(BINARY_SYNC);
+	system_status |= UART_transmit(length + 2);
+	system_status |= UART_transmit(opcode);
+	system_status |= UART_transmit(status);
+	
+	for(uint8_t data_index = 0; data_index < length; data_index++){
+		crc = CRC8_update(crc, data[data_index]);
+		system_status |= UART_transmit(data[data_index]);
+	}
+	
+	system_status |= UART_transmit(crc);
+	
+	return system_status;
+}
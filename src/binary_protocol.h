@@ -0,0 +1,72 @@
+/*
+ * binary_protocol.h
+ *
+ * Created: 10/17/2026 9:41:12 AM
+ *  Author: aparady
+ */ 
+
+
+#ifndef BINARY_PROTOCOL_H_
+#define BINARY_PROTOCOL_H_
+
+#include <avr/io.h>
+
+/*
+Every frame in either direction is SYNC, LENGTH, LENGTH bytes of payload, then a CRC-8 (polynomial 0x07) over LENGTH and the payload.
+A request payload is an opcode followed by its arguments. A response payload is the request's opcode, a status byte and any data.
+*/
+
+#define BINARY_SYNC 0xA5
+#define BINARY_PAYLOAD_LENGTH 255
+
+enum BINARY_OPCODES{
+	BINARY_OP_IDENTIFY				= 0x01,	// Data: '='
+	BINARY_OP_TRANSACTION				= 0x02,	// Arguments: transaction steps below. Data: every byte read, in order
+	BINARY_OP_STATUS				= 0x03,	// Status is the current I2C state, which is then cleared and the bus reset if it was not clean
+	BINARY_OP_GET_SPEED				= 0x04,	// Data: TWBR, TWSR prescaler bits
+	BINARY_OP_SET_SPEED				= 0x05,	// Argument: 0 = 10kHz, 1 = 100kHz, 2 = 400kHz
+	BINARY_OP_BROADCAST				= 0x06,	// Argument: 0 = check the bus state machine, anything else = broadcast mode
+	BINARY_OP_POLL_ADD				= 0x07,	// Arguments: period in ms (16 bit, low byte first), then transaction steps to repeat. Data: entry
+	BINARY_OP_POLL_REMOVE				= 0x08,	// Argument: entry, or FF for all. Data: entries still scheduled
+	BINARY_OP_POLL_SAMPLE				= 0x09,	// Sent unprompted. Status is the poll's own. Data: entry, microseconds (32 bit, low byte first), skipped periods, bytes read
+	BINARY_OP_SCAN					= 0x0A,	// Arguments: first address, last address, probe (0 = quick write, 1 = read byte). Data: 16 byte presence bitmap
+	BINARY_OP_FREQUENCY				= 0x0B,	// Argument: optional clock in Hz (32 bit, low byte first), rounded down to a rate the TWI can make. Data: clock in Hz, same layout
+	BINARY_OP_TIMEOUT				= 0x0C,	// Arguments: optional bus operation timeout in ms (16 bit, low byte first, 0 = unchanged), SMBus clock low timeout on/off. Data: same layout
+	BINARY_OP_FAULT					= 0x0D,	// Sent unprompted after a fault was recovered from. Status is the SYSTEM_ERROR_CODES value. Data: times it has happened (16 bit, low byte first)
+	BINARY_OP_COUNTERS				= 0x0E,	// Argument: optional, anything but 0 resets them after the reply. Data: STATS_COUNTERS, then min, average and max microseconds of each of STATS_TIMERS (all 32 bit, low byte first), then RX overruns (16 bit)
+	BINARY_OP_BATCH					= 0x0F,	// Arguments: transaction steps, with a STOP step between transactions. Data: for every transaction its status, how many bytes it read and the bytes
+	BINARY_OP_EEPROM				= 0x10,	// Arguments: address, address bytes, page size (0 = 256), memory address (16 bit, low byte first), verify, data. Data: bytes written (16 bit), 1 if that was all of them
+	BINARY_OP_POLL_UNTIL				= 0x11,	// Arguments: mask, expected value, interval in ms, timeout in ms (all 16 bit, low byte first), transaction steps. Data: reads taken (16 bit), 1 if the value matched, bytes read by the last one
+	BINARY_OP_GATHER				= 0x12,	// Arguments: command code, bytes to read, then device addresses, none = every device the last scans found. Data: for every device its address, status and the bytes, zero filled where the read failed
+	BINARY_OP_ALERT_MODE				= 0x13,	// Argument: optional I2C_ALERT_MODES value. Data: the mode
+	BINARY_OP_ALERT					= 0x14,	// Sent unprompted for every device found through the Alert Response Address. Status is the reads' own. Data: address (FF if nobody answered), then STATUS_WORD (16 bit, low byte first) if asked for
+	BINARY_OP_TRACE					= 0x15,	// Argument: optional, 0 = stop tracing, anything else = trace. Data: the trace, oldest first, as TWSR status or TRACE_EVENTS value and tick (16 bit, low byte first) per entry. Clears the trace.
+	BINARY_OP_MACRO_STORE				= 0x16,	// Arguments: entry, then transaction steps as in a batch, none = free the entry. Data: entry
+	BINARY_OP_MACRO_RUN				= 0x17,	// Arguments: entry, optional address to use instead of the macro's first device. Data: as TRANSACTION for a macro of one transaction, as BATCH for more
+	BINARY_OP_CACHE					= 0x18,	// Arguments: optional mode (00 = off, 01 = on, 02 = empty, else unchanged), then pairs of command code and 01 to cache it or 00 not to. Data: on, then hits and misses in 16 bits, from before the change
+	BINARY_OP_ASCII					= 0x7F,	// Return to the ASCII command language after the response
+	BINARY_OP_ERROR					= 0xFF	// Response only, the status byte holds a BINARY_ERROR_CODES value
+};
+
+enum BINARY_TRANSACTION_STEPS{
+	BINARY_STEP_WRITE_ADDRESS			= 0x01,	// ADDR: Start + Addr + W
+	BINARY_STEP_READ_ADDRESS			= 0x02,	// ADDR COUNT: Start + Addr + R, then read COUNT bytes
+	BINARY_STEP_WRITE_DATA				= 0x03,	// COUNT DATA...: Write COUNT data bytes
+	BINARY_STEP_STOP				= 0x04,	// Stop + the next step starts a new transaction, only in a batch
+	BINARY_STEP_PEC					= 0x10,	// OR'd into a read or write step: a PEC is read and checked after the data, or appended to it
+	BINARY_STEP_BLOCK				= 0x20	// OR'd into a read step: the slave's count byte sets the length, with COUNT as the limit
+};
+
+enum BINARY_ERROR_CODES{
+	BINARY_NO_ERROR					= 0x00,	// No problems reported
+	BINARY_FRAME_ERROR				= 0x01,	// CRC mismatch or empty frame
+	BINARY_UNKNOWN_OPCODE				= 0x02,	// Opcode is not one of BINARY_OPCODES
+	BINARY_MALFORMED_REQUEST			= 0x03,	// Arguments are missing, malformed or ask for more data than fits in a response
+	BINARY_NO_ROOM					= 0x04	// A table on the bridge is full, or the entry is too big for it
+};
+
+uint8_t BINARY_receive_frame(uint8_t *payload);
+
+uint8_t BINARY_transmit_frame(uint8_t opcode, uint8_t status, uint8_t *data, uint8_t length);
+
+#endif /* BINARY_PROTOCOL_H_ */
@@ -0,0 +1,337 @@
+/*
+ * cache.c
+ *
+ * Created: 10/17/2026 7:12:40 PM
+ *  Author: aparady
+ */ 
+
+#ifndef F_CPU
+#warning "F_CPU not defined!"
+
+#define F_CPU 16000000UL
+#endif
+
+#include <avr/io.h>
+#include <string.h>
+
+#include "cache.h"
+#include "i2c_engine.h"
+#include "arduino_errors.h"
+
+#if CACHE_ENTRIES != 0
+
+// Static identification registers, COEFFICIENTS and PMBUS_REVISION through MFR_SERIAL
+static const uint8_t CACHE_defaults[] = {0x30, 0x98, 0x99, 0x9A, 0x9B, 0x9C, 0x9D, 0x9E};
+
+static uint8_t CACHE_on = 0;
+static uint8_t CACHE_allowlist[32]; // Command code n is bit n % 8 of byte n / 8
+static uint16_t CACHE_hits = 0;
+static uint16_t CACHE_misses = 0;
+
+// An entry is the transaction that read it, up to its STOP or END, the PAGE it was read on and what came back
+static uint8_t CACHE_keys[CACHE_ENTRIES][CACHE_KEY_LENGTH];
+static uint8_t CACHE_key_lengths[CACHE_ENTRIES]; // 0 marks a free entry
+static uint8_t CACHE_key_pages[CACHE_ENTRIES];
+static uint8_t CACHE_data[CACHE_ENTRIES][CACHE_DATA_LENGTH];
+static uint8_t CACHE_data_lengths[CACHE_ENTRIES];
+static uint8_t CACHE_ages[CACHE_ENTRIES]; // Always a permutation of 0 to CACHE_ENTRIES - 1, 0 is the most recently used
+
+static uint8_t CACHE_page_addresses[CACHE_DEVICES]; // 0xFF marks a free slot
+static uint8_t CACHE_pages[CACHE_DEVICES];
+
+// Length of a transaction that is a write of a command code and its parameters followed by a read from the same device, or 0 for anything else
+static uint8_t CACHE_read_length(uint8_t *transaction){
+	uint8_t index = 0;
+	
+	if((transaction[0] != I2C_OP_ADDRESS) || (transaction[1] & 0x01)) return 0;
+	if((transaction[2] & I2C_OP_MASK) != I2C_OP_WRITE) return 0;
+	if((transaction[3] == 0) || (transaction[3] > (CACHE_KEY_LENGTH - 8))) return 0;
+	
+	index = 4 + transaction[3];
+	
+	if((transaction[index] != I2C_OP_ADDRESS) || (transaction[index + 1] != (transaction[1] | 0x01))) return 0;
+	if((transaction[index + 2] & I2C_OP_MASK) != I2C_OP_READ) return 0;
+	
+	index += 4;
+	
+	if((transaction[index] != I2C_OP_END) && (transaction[index] != I2C_OP_STOP)) return 0;
+	
+	return index;
+}
+
+// True for a transaction that only writes PAGE
+static uint8_t CACHE_page_write(uint8_t *transaction){
+	if((transaction[0] != I2C_OP_ADDRESS) || (transaction[1] & 0x01)) return 0;
+	if(((transaction[2] & I2C_OP_MASK) != I2C_OP_WRITE) || (transaction[3] != 2) || (transaction[4] != CACHE_PAGE_COMMAND)) return 0;
+	
+	return (transaction[6] == I2C_OP_END) || (transaction[6] == I2C_OP_STOP);
+}
+
+// Drop every entry read from address
+static void CACHE_invalidate(uint8_t address){
+	for(uint8_t entry = 0; entry < CACHE_ENTRIES; entry++){
+		if((CACHE_key_lengths[entry] != 0) && ((CACHE_keys[entry][1] >> 1) == address)) CACHE_key_lengths[entry] = 0;
+	}
+}
+
+static uint8_t CACHE_page_slot(uint8_t address){
+	for(uint8_t slot = 0; slot < CACHE_DEVICES; slot++){
+		if(CACHE_page_addresses[slot] == address) return slot;
+	}
+	
+	return 0xFF;
+}
+
+static uint8_t CACHE_page(uint8_t address){
+	uint8_t slot = CACHE_page_slot(address);
+	
+	return (slot == 0xFF) ? CACHE_PAGE_UNKNOWN : CACHE_pages[slot];
+}
+
+// With every slot taken the first one is reused, and the device it held loses its cached reads with its PAGE
+static void CACHE_page_set(uint8_t address, uint8_t page){
+	uint8_t slot = CACHE_page_slot(address);
+	
+	if(slot == 0xFF) slot = CACHE_page_slot(0xFF);
+	if(slot == 0xFF) slot = 0;
+	
+	if(CACHE_page_addresses[slot] != address) CACHE_invalidate(CACHE_page_addresses[slot]);
+	
+	CACHE_page_addresses[slot] = address;
+	CACHE_pages[slot] = page;
+}
+
+// Make entry the most recently used one
+static void CACHE_touch(uint8_t entry){
+	for(uint8_t other = 0; other < CACHE_ENTRIES; other++){
+		if(CACHE_ages[other] < CACHE_ages[entry]) CACHE_ages[other]++;
+	}
+	
+	CACHE_ages[entry] = 0;
+}
+
+// Drop a device's entries and its PAGE as well
+static void CACHE_forget(uint8_t address){
+	uint8_t slot = CACHE_page_slot(address);
+	
+	CACHE_invalidate(address);
+	
+	if(slot != 0xFF) CACHE_page_addresses[slot] = 0xFF;
+}
+
+// Drop the entries of every device the transaction wrote to, or with forget set of every device it named along with their PAGEs
+static void CACHE_drop(uint8_t *transaction, uint8_t forget){
+	for(uint16_t index = 0; (transaction[index] != I2C_OP_END) && (transaction[index] != I2C_OP_STOP);){
+		switch(transaction[index] & I2C_OP_MASK){
+			case I2C_OP_ADDRESS:
+				if(forget){
+					CACHE_forget(transaction[index + 1] >> 1);
+				}
+				else if(!(transaction[index + 1] & 0x01)){
+					CACHE_invalidate(transaction[index + 1] >> 1);
+				}
+				index += 2;
+				break;
+			
+			case I2C_OP_WRITE:
+				index += 2 + transaction[index + 1];
+				break;
+			
+			case I2C_OP_READ:
+				index += 2;
+				break;
+			
+			default: // A stream step is the last one of its transaction
+				return;
+		}
+	}
+}
+
+// Finds the entry for a read, or 0xFF
+static uint8_t CACHE_find(uint8_t *transaction, uint8_t key_length){
+	uint8_t page = CACHE_page(transaction[1] >> 1);
+	
+	for(uint8_t entry = 0; entry < CACHE_ENTRIES; entry++){
+		if((CACHE_key_lengths[entry] == key_length) && (CACHE_key_pages[entry] == page) && (memcmp(CACHE_keys[entry], transaction, key_length) == 0)) return entry;
+	}
+	
+	return 0xFF;
+}
+
+// The allowlist survives the cache being turned off and on
+void CACHE_init(){
+	for(uint8_t index = 0; index < sizeof(CACHE_defaults); index++) CACHE_allow(CACHE_defaults[index], 1);
+	
+	for(uint8_t entry = 0; entry < CACHE_ENTRIES; entry++) CACHE_ages[entry] = entry;
+	
+	CACHE_flush();
+}
+
+// Turning the cache on or off also empties it, so nothing read before is trusted after
+void CACHE_mode(uint8_t mode){
+	if(mode != CACHE_EMPTY) CACHE_on = (mode == CACHE_ON);
+	
+	CACHE_hits = 0;
+	CACHE_misses = 0;
+	
+	CACHE_flush();
+}
+
+uint8_t CACHE_enabled(){
+	return CACHE_on;
+}
+
+void CACHE_counts(uint16_t *hits, uint16_t *misses){
+	*hits = CACHE_hits;
+	*misses = CACHE_misses;
+}
+
+// Taking a command off the allowlist drops what is kept of it
+void CACHE_allow(uint8_t command, uint8_t allowed){
+	if(allowed){
+		CACHE_allowlist[command >> 3] |= 1 << (command & 0x07);
+		return;
+	}
+	
+	CACHE_allowlist[command >> 3] &= ~(1 << (command & 0x07));
+	
+	for(uint8_t entry = 0; entry < CACHE_ENTRIES; entry++){
+		if(CACHE_keys[entry][4] == command) CACHE_key_lengths[entry] = 0;
+	}
+}
+
+uint8_t CACHE_allowed(uint8_t command){
+	return (CACHE_allowlist[command >> 3] >> (command & 0x07)) & 0x01;
+}
+
+// The data kept for the transaction starting at transaction, or 0 if it has to go to the bus. Only reads that could be kept count as misses.
+uint8_t *CACHE_lookup(uint8_t *transaction, uint8_t *length){
+	uint8_t key_length = 0;
+	uint8_t entry = 0;
+	
+	if(!CACHE_on) return 0;
+	
+	key_length = CACHE_read_length(transaction);
+	if((key_length == 0) || !CACHE_allowed(transaction[4])) return 0;
+	
+	entry = CACHE_find(transaction, key_length);
+	
+	if(entry == 0xFF){
+		CACHE_misses++;
+		return 0;
+	}
+	
+	CACHE_hits++;
+	CACHE_touch(entry);
+	*length = CACHE_data_lengths[entry];
+	
+	return CACHE_data[entry];
+}
+
+// Called with every transaction the engine finishes, cached or not, so writes drop what they may have changed. A successful read is kept only if keep is set.
+void CACHE_update(uint8_t *transaction, uint8_t I2C_status, uint8_t *data, uint16_t length, uint8_t keep){
+	uint8_t key_length = 0;
+	uint8_t entry = 0;
+	
+	if(!CACHE_on || (transaction[0] != I2C_OP_ADDRESS)) return;
+	
+	// The device may have been power cycled, which puts it back on its default PAGE. The NACK could have come from any address in the transaction, a mux's or the device's behind it.
+	if(I2C_status & I2C_ADDR_NACK){
+		CACHE_drop(transaction, 1);
+		return;
+	}
+	
+	key_length = CACHE_read_length(transaction);
+	
+	if(key_length != 0){
+		if(!keep || (I2C_status != I2C_NO_ERROR) || !CACHE_allowed(transaction[4]) || (length > CACHE_DATA_LENGTH)) return;
+		
+		entry = CACHE_find(transaction, key_length);
+		
+		// A free entry is used before the least recently used one
+		for(uint8_t other = 0; (entry == 0xFF) && (other < CACHE_ENTRIES); other++){
+			if(CACHE_key_lengths[other] == 0) entry = other;
+		}
+		for(uint8_t other = 0; (entry == 0xFF) && (other < CACHE_ENTRIES); other++){
+			if(CACHE_ages[other] == (CACHE_ENTRIES - 1)) entry = other;
+		}
+		
+		memcpy(CACHE_keys[entry], transaction, key_length);
+		CACHE_key_lengths[entry] = key_length;
+		CACHE_key_pages[entry] = CACHE_page(transaction[1] >> 1);
+		memcpy(CACHE_data[entry], data, length);
+		CACHE_data_lengths[entry] = length;
+		CACHE_touch(entry);
+		return;
+	}
+	
+	// A PAGE write that did not go through leaves the device on a PAGE nobody knows
+	if(CACHE_page_write(transaction)){
+		if(I2C_status == I2C_NO_ERROR){
+			CACHE_page_set(transaction[1] >> 1, transaction[5]);
+		}
+		else{
+			CACHE_forget(transaction[1] >> 1);
+		}
+		return;
+	}
+	
+	// Anything else written to a device may have changed what it would answer
+	CACHE_drop(transaction, 0);
+}
+
+// Forget every entry and every device's PAGE, after a bus reset nothing can be trusted
+void CACHE_flush(){
+	for(uint8_t entry = 0; entry < CACHE_ENTRIES; entry++) CACHE_key_lengths[entry] = 0;
+	for(uint8_t slot = 0; slot < CACHE_DEVICES; slot++) CACHE_page_addresses[slot] = 0xFF;
+}
+
+#else
+
+// Left out of the build, the arguments are ignored and (void) keeps -Wextra quiet about them
+void CACHE_init(){
+}
+
+void CACHE_mode(uint8_t mode){
+	(void)mode;
+}
+
+uint8_t CACHE_enabled(){
+	return 0;
+}
+
+void CACHE_counts(uint16_t *hits, uint16_t *misses){
+	*hits = 0;
+	*misses = 0;
+}
+
+void CACHE_allow(uint8_t command, uint8_t allowed){
+	(void)command;
+	(void)allowed;
+}
+
+uint8_t CACHE_allowed(uint8_t command){
+	(void)command;
+	
+	return 0;
+}
+
+uint8_t *CACHE_lookup(uint8_t *transaction, uint8_t *length){
+	(void)transaction;
+	(void)length;
+	
+	return 0;
+}
+
+void CACHE_update(uint8_t *transaction, uint8_t I2C_status, uint8_t *data, uint16_t length, uint8_t keep){
+	(void)transaction;
+	(void)I2C_status;
+	(void)data;
+	(void)length;
+	(void)keep;
+}
+
+void CACHE_flush(){
+}
+
+#endif
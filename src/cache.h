@@ -0,0 +1,55 @@
+/*
+ * cache.h
+ *
+ * Created: 10/17/2026 7:12:40 PM
+ *  Author: aparady
+ */ 
+
+
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include <avr/io.h>
+
+/*
+Reads of registers that do not change while a device is powered, like MFR_ID or PMBUS_REVISION, are kept in SRAM and answered from there without touching the bus.
+A read is kept when it is a write of one command code, with up to three more bytes for a process call like COEFFICIENTS, then a read from the same device, and the command code is on the allowlist.
+Entries are matched on the whole transaction and on the PAGE last written to the device through the bridge, and the least recently used one makes way for a new read.
+Any other write to a device drops its entries, a NACK forgets the entries and PAGE of every device in the transaction, and a bus reset empties the cache. Changes made behind the bridge's back are not seen.
+Built with CACHE_ENTRIES of 0, as board builds are, the functions are still there, but nothing is kept and the cache never turns on. Only the simulator sets it.
+*/
+
+#ifndef CACHE_ENTRIES
+#define CACHE_ENTRIES 0 // Every entry takes 50 bytes of SRAM, which the ATmega328P does not have to spare, so the cache is only built in when this is set at compile time
+#endif
+#define CACHE_KEY_LENGTH 12 // Longest transaction kept: address, a write of four bytes, address and read
+#define CACHE_DATA_LENGTH 34 // Block count, 32 data bytes and PEC
+#define CACHE_DEVICES 8 // Devices whose PAGE is remembered
+#define CACHE_PAGE_UNKNOWN 0xFF // No PAGE has been written to the device since it last answered with a NACK or the cache was emptied
+#define CACHE_PAGE_COMMAND 0x00 // PMBus PAGE
+
+enum CACHE_MODES{
+	CACHE_OFF					= 0x00,	// Every read goes to the bus
+	CACHE_ON					= 0x01,	// Allowed reads are kept and answered from SRAM
+	CACHE_EMPTY					= 0x02	// Drop every entry and count again from zero, staying on or off
+};
+
+void CACHE_init();
+
+void CACHE_mode(uint8_t mode);
+
+uint8_t CACHE_enabled();
+
+void CACHE_counts(uint16_t *hits, uint16_t *misses);
+
+void CACHE_allow(uint8_t command, uint8_t allowed);
+
+uint8_t CACHE_allowed(uint8_t command);
+
+uint8_t *CACHE_lookup(uint8_t *transaction, uint8_t *length);
+
+void CACHE_update(uint8_t *transaction, uint8_t I2C_status, uint8_t *data, uint16_t length, uint8_t keep);
+
+void CACHE_flush();
+
+#endif /* CACHE_H_ */
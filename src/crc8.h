@@ -0,0 +1,20 @@
+/*
+ * crc8.h
+ *
+ * Created: 10/17/2026 1:18:44 PM
+ *  Author: aparady
+ */ 
+
+
+#ifndef CRC8_H_
+#define CRC8_H_
+
+#include <avr/io.h>
+
+/*
+CRC-8 with polynomial 0x07 and a zero initial value, as used by the SMBus PEC and the binary frames.
+*/
+
+uint8_t CRC8_update(uint8_t crc, uint8_t data);
+
+#endif /* CRC8_H_ */
@@ -0,0 +1,185 @@
+/*
+ * i2c_eeprom.c
+ *
+ * Created: 10/17/2026 4:12:08 PM
+ *  Author: aparady
+ */ 
+
+#ifndef F_CPU
+#warning "F_CPU not defined!"
+
+#define F_CPU 16000000UL
+#endif
+
+#include <avr/io.h>
+
+#include "i2c_eeprom.h"
+#include "i2c_engine.h"
+#include "arduino_drivers.h"
+#include "arduino_errors.h"
+
+// The page being filled is kept as the program that writes it, so it can also be compared against what is read back
+static uint8_t *I2C_eeprom_program;
+static uint8_t I2C_eeprom_device = 0;
+static uint8_t I2C_eeprom_address_bytes = 2;
+static uint16_t I2C_eeprom_page_size = 0;
+static uint16_t I2C_eeprom_address = 0; // Memory address the next queued byte goes to
+static uint16_t I2C_eeprom_page_start = 0; // Memory address of the first byte of the page being filled
+static uint16_t I2C_eeprom_queued = 0; // Bytes in the page being filled
+static uint16_t I2C_eeprom_done = 0; // Bytes written, and read back if verifying
+static uint8_t I2C_eeprom_verify = 0;
+static uint8_t I2C_eeprom_status = I2C_NO_ERROR;
+static uint8_t I2C_eeprom_match = 1;
+
+// SLA+W or SLA+R for a memory address, with its upper bits in the device address when there is only one address byte
+static uint8_t I2C_eeprom_slave(uint16_t memory_address, uint8_t read){
+	uint8_t address = I2C_eeprom_device;
+	
+	if(I2C_eeprom_address_bytes == 1) address |= (memory_address >> 8) & 0x07;
+	
+	return (address << 1) | read;
+}
+
+// Program index of byte n of the page, after the address and memory address steps and the write step headers before it
+static uint16_t I2C_eeprom_data_index(uint16_t n){
+	return 4 + I2C_eeprom_address_bytes + ((n / I2C_EEPROM_CHUNK) * (2 + I2C_EEPROM_CHUNK)) + 2 + (n % I2C_EEPROM_CHUNK);
+}
+
+// Fill in the steps around the page data, returns the index of the first step after the memory address
+static uint8_t I2C_eeprom_header(uint8_t *program, uint16_t memory_address){
+	uint8_t index = 0;
+	
+	program[index++] = I2C_OP_ADDRESS;
+	program[index++] = I2C_eeprom_slave(memory_address, 0);
+	program[index++] = I2C_OP_WRITE;
+	program[index++] = I2C_eeprom_address_bytes;
+	
+	if(I2C_eeprom_address_bytes == 2) program[index++] = memory_address >> 8;
+	program[index++] = memory_address;
+	
+	return index;
+}
+
+static uint8_t I2C_eeprom_run(uint8_t *program){
+	uint8_t I2C_status;
+	
+	I2C_engine_start(program, I2C_ENGINE_CHECKED);
+	I2C_engine_wait();
+	I2C_status = I2C_engine_finish();
+	
+	return I2C_status;
+}
+
+// The device ignores its address for as long as its write cycle runs, so the first ACK means the page is in
+static uint8_t I2C_eeprom_ack_poll(){
+	uint8_t program[3] = {I2C_OP_ADDRESS, I2C_eeprom_slave(I2C_eeprom_page_start, 0), I2C_OP_END};
+	uint32_t started = TIMER_now();
+	uint8_t I2C_status;
+	
+	do{
+		I2C_status = I2C_eeprom_run(program);
+	}while((I2C_status == I2C_ADDR_NACK) && ((TIMER_now() - started) < ((uint32_t)I2C_EEPROM_WRITE_CYCLE_MS * TIMER_TICKS_PER_MS)));
+	
+	return I2C_status;
+}
+
+// Read the page back a chunk at a time and compare it with the data in the write program
+static uint8_t I2C_eeprom_compare(){
+	uint8_t program[11];
+	uint8_t index;
+	uint8_t *result;
+	uint16_t result_length = 0;
+	uint8_t I2C_status = I2C_NO_ERROR;
+	
+	for(uint16_t offset = 0; offset < I2C_eeprom_queued; offset += I2C_EEPROM_CHUNK){
+		index = I2C_eeprom_header(program, I2C_eeprom_page_start + offset);
+		program[index++] = I2C_OP_ADDRESS;
+		program[index++] = I2C_eeprom_slave(I2C_eeprom_page_start + offset, 1);
+		program[index++] = I2C_OP_READ;
+		program[index++] = ((I2C_eeprom_queued - offset) < I2C_EEPROM_CHUNK) ? (I2C_eeprom_queued - offset) : I2C_EEPROM_CHUNK;
+		program[index++] = I2C_OP_END;
+		
+		I2C_status = I2C_eeprom_run(program);
+		result = I2C_result_data(&result_length);
+		
+		for(uint16_t n = 0; (I2C_status == I2C_NO_ERROR) && (n < result_length); n++){
+			if(result[n] != I2C_eeprom_program[I2C_eeprom_data_index(offset + n)]) I2C_eeprom_match = 0;
+		}
+		
+		I2C_result_clear();
+		
+		if((I2C_status != I2C_NO_ERROR) || !I2C_eeprom_match) break;
+	}
+	
+	return I2C_status;
+}
+
+// Write the page that has been filled so far, wait out its write cycle and check it
+static void I2C_eeprom_flush(){
+	uint16_t end = 0;
+	
+	if(I2C_eeprom_queued == 0) return;
+	
+	I2C_eeprom_header(I2C_eeprom_program, I2C_eeprom_page_start);
+	
+	for(uint16_t n = 0; n < I2C_eeprom_queued; n += I2C_EEPROM_CHUNK){
+		end = I2C_eeprom_data_index(n) - 2;
+		I2C_eeprom_program[end] = I2C_OP_WRITE;
+		I2C_eeprom_program[end + 1] = ((I2C_eeprom_queued - n) < I2C_EEPROM_CHUNK) ? (I2C_eeprom_queued - n) : I2C_EEPROM_CHUNK;
+	}
+	I2C_eeprom_program[I2C_eeprom_data_index(I2C_eeprom_queued - 1) + 1] = I2C_OP_END;
+	
+	I2C_eeprom_status = I2C_eeprom_run(I2C_eeprom_program);
+	
+	if(I2C_eeprom_status == I2C_NO_ERROR) I2C_eeprom_status = I2C_eeprom_ack_poll();
+	if((I2C_eeprom_status == I2C_NO_ERROR) && I2C_eeprom_verify) I2C_eeprom_status = I2C_eeprom_compare();
+	
+	if((I2C_eeprom_status == I2C_NO_ERROR) && I2C_eeprom_match) I2C_eeprom_done += I2C_eeprom_queued;
+	
+	I2C_eeprom_page_start = I2C_eeprom_address;
+	I2C_eeprom_queued = 0;
+}
+
+// program must have room for I2C_EEPROM_PROGRAM_LENGTH bytes and be left alone until I2C_eeprom_end(). A page size of 0 means 256.
+void I2C_eeprom_begin(uint8_t *program, uint8_t address, uint8_t address_bytes, uint16_t page_size, uint16_t memory_address, uint8_t verify){
+	I2C_eeprom_program = program;
+	I2C_eeprom_device = address & 0x7F;
+	I2C_eeprom_address_bytes = (address_bytes == 1) ? 1 : 2;
+	I2C_eeprom_page_size = ((page_size == 0) || (page_size > I2C_EEPROM_PAGE_LENGTH)) ? I2C_EEPROM_PAGE_LENGTH : page_size;
+	I2C_eeprom_address = memory_address;
+	I2C_eeprom_page_start = memory_address;
+	I2C_eeprom_queued = 0;
+	I2C_eeprom_done = 0;
+	I2C_eeprom_verify = verify;
+	I2C_eeprom_status = I2C_NO_ERROR;
+	I2C_eeprom_match = 1;
+}
+
+// Queue the next byte, writing the page once it is full or the next byte would start a new one. After a failure the rest is thrown away.
+uint8_t I2C_eeprom_write(uint8_t data){
+	if((I2C_eeprom_status != I2C_NO_ERROR) || !I2C_eeprom_match) return I2C_eeprom_status;
+	
+	I2C_eeprom_program[I2C_eeprom_data_index(I2C_eeprom_queued++)] = data;
+	I2C_eeprom_address++;
+	
+	// Writing on past the boundary would wrap around to the start of the same page
+	if((I2C_eeprom_address % I2C_eeprom_page_size) == 0) I2C_eeprom_flush();
+	
+	return I2C_eeprom_status;
+}
+
+// Write whatever is left of the last page
+uint8_t I2C_eeprom_end(){
+	if((I2C_eeprom_status == I2C_NO_ERROR) && I2C_eeprom_match) I2C_eeprom_flush();
+	
+	return I2C_eeprom_status;
+}
+
+uint16_t I2C_eeprom_written(){
+	return I2C_eeprom_done;
+}
+
+// 0 if a page read back differently from what was written, which ends the programming like a bus error does
+uint8_t I2C_eeprom_matched(){
+	return I2C_eeprom_match;
+}
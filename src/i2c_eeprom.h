@@ -0,0 +1,35 @@
+/*
+ * i2c_eeprom.h
+ *
+ * Created: 10/17/2026 4:12:08 PM
+ *  Author: aparady
+ */ 
+
+
+#ifndef I2C_EEPROM_H_
+#define I2C_EEPROM_H_
+
+#include <avr/io.h>
+
+/*
+Bulk programming of 24Cxx style EEPROMs. Bytes are queued one at a time and every page goes out as one write as soon as it is full or the next byte would cross its boundary.
+After each page the device is polled with SLA+W until it ACKs, which is the moment its write cycle has ended, and the page is read back and compared if asked to.
+Parts with one address byte and more than 256 bytes take the upper address bits in the low bits of the device address, as the 24C04 to 24C16 do.
+*/
+
+#define I2C_EEPROM_PAGE_LENGTH 256 // Largest page supported, as on the 24M01
+#define I2C_EEPROM_CHUNK 128 // Page data goes in write steps of this many bytes, and is read back in reads of the same size
+#define I2C_EEPROM_PROGRAM_LENGTH (6 + ((I2C_EEPROM_PAGE_LENGTH / I2C_EEPROM_CHUNK) * (2 + I2C_EEPROM_CHUNK)) + 1) // Address and memory address steps, the page data and END
+#define I2C_EEPROM_WRITE_CYCLE_MS 20 // Longest ACK polling waits for a write cycle, data sheets give 5 or 10 ms
+
+void I2C_eeprom_begin(uint8_t *program, uint8_t address, uint8_t address_bytes, uint16_t page_size, uint16_t memory_address, uint8_t verify);
+
+uint8_t I2C_eeprom_write(uint8_t data);
+
+uint8_t I2C_eeprom_end();
+
+uint16_t I2C_eeprom_written();
+
+uint8_t I2C_eeprom_matched();
+
+#endif /* I2C_EEPROM_H_ */
@@ -0,0 +1,555 @@
+/*
+ * i2c_engine.c
+ *
+ * Created: 10/17/2026 11:02:37 AM
+ *  Author: aparady
+ */ 
+
+#ifndef F_CPU
+#warning "F_CPU not defined!"
+
+#define F_CPU 16000000UL
+#endif
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "i2c_engine.h"
+#include "arduino_drivers.h"
+#include "arduino_errors.h"
+#include "crc8.h"
+#include "stats.h"
+#include "trace.h"
+#include "cache.h"
+
+#define I2C_RESULT_BUFFER_LENGTH 258 // Largest single read: 255 data bytes plus a block count and PEC
+#define I2C_RESULT_READS 8 // Reads per transaction whose ends can be remembered before the buffer has to be sent early
+#define I2C_STREAM_BUFFER_LENGTH 16 // Must be a power of two, bytes fed to a stream step ahead of the bus
+
+#define I2C_ENGINE_CONTROL ((1 << TWINT) | (1 << TWEN) | (1 << TWIE)) // Clear TWINT to start the next operation and interrupt when it is done
+
+enum I2C_ENGINE_PHASES{
+	I2C_PHASE_START,				// START or repeated START is going out
+	I2C_PHASE_ADDRESS,				// SLA+W or SLA+R is going out
+	I2C_PHASE_WRITE,				// Data byte is going out, I2C_engine_remaining counts the ones after it
+	I2C_PHASE_READ,					// Data byte is coming in, I2C_engine_remaining counts this one
+	I2C_PHASE_STREAM,				// Data byte of a stream step is going out, or the bus is held waiting for one
+	I2C_PHASE_STOPPED				// STOP has gone out between two transactions of a batch
+};
+
+// Data read during a transaction is held here and only sent to the host after the STOP, so the bus is not left waiting on the UART between bytes
+static volatile uint8_t I2C_result_buffer[I2C_RESULT_BUFFER_LENGTH];
+static volatile uint16_t I2C_result_length = 0;
+static volatile uint16_t I2C_result_read_end[I2C_RESULT_READS];
+static volatile uint8_t I2C_result_reads = 0;
+static uint16_t I2C_result_first = 0; // Where the transaction being executed started putting its reads
+static volatile uint8_t I2C_result_held = 0; // The bus was held to send reads early, so the buffer does not have all of this transaction's
+
+// The transaction being executed and where the interrupt is in it
+static uint8_t *I2C_engine_steps;
+static uint16_t I2C_engine_index = 0;
+static uint16_t I2C_engine_step = 0; // Where the step being executed starts, so a failed transaction can be skipped whole
+static uint16_t I2C_engine_first = 0; // Where the transaction being executed starts, for the cache to look at once it is over
+static uint8_t I2C_engine_cache_hit = 0; // The transaction was answered from the cache
+static uint16_t I2C_engine_remaining = 0;
+static uint8_t I2C_engine_block_limit = 0; // Most data bytes a block read will take, whatever count the slave sends
+static uint8_t I2C_engine_acking = 0; // The byte coming in is being ACK'd
+static uint8_t I2C_engine_phase = I2C_PHASE_START;
+static uint8_t I2C_engine_options = 0;
+static uint8_t I2C_engine_flags = 0; // I2C_PROGRAM_FLAGS of the step in progress
+static uint8_t I2C_engine_pec = 0; // CRC-8 of every address and data byte since the first START
+static volatile uint8_t I2C_engine_state = I2C_ENGINE_IDLE;
+static volatile uint8_t I2C_engine_status = I2C_NO_ERROR;
+
+// TIMER_now() at I2C_engine_start() and when the STOP went out, the difference is counted as bus time
+static uint32_t I2C_engine_started_at = 0;
+static volatile uint32_t I2C_engine_stopped_at = 0;
+
+// Bytes for a stream step, filled by I2C_engine_feed() and drained by the interrupt
+static volatile uint8_t I2C_stream_buffer[I2C_STREAM_BUFFER_LENGTH];
+static volatile uint8_t I2C_stream_head = 0;
+static volatile uint8_t I2C_stream_tail = 0;
+static volatile uint8_t I2C_stream_closed = 0; // No more bytes are coming, the step ends once the buffer is empty
+
+// What scans have found so far. Address n is bit n % 8 of byte n / 8.
+static uint8_t I2C_presence_scanned[16];
+static uint8_t I2C_presence_found[16];
+
+// Bumped by every interrupt so a waiting loop can tell a slow bus from a stuck one
+static volatile uint8_t I2C_engine_progress = 0;
+static uint8_t I2C_engine_progress_seen = 0;
+
+// A block read only knows which byte is its last once the count is in, so every byte asks for room for a read end as well
+static uint8_t I2C_result_room(){
+	if(I2C_result_length == I2C_RESULT_BUFFER_LENGTH) return 0;
+	
+	return !((I2C_engine_options & I2C_ENGINE_MARK_READS) && (I2C_result_reads == I2C_RESULT_READS));
+}
+
+// Index of the I2C_OP_STOP or END that closes the transaction the current step belongs to
+static uint16_t I2C_engine_transaction_end(){
+	uint16_t index = I2C_engine_step;
+	
+	while(1){
+		switch(I2C_engine_steps[index] & I2C_OP_MASK){
+			case I2C_OP_ADDRESS:
+			case I2C_OP_READ:
+				index += 2;
+				break;
+			
+			case I2C_OP_WRITE:
+				index += 2 + I2C_engine_steps[index + 1];
+				break;
+			
+			case I2C_OP_STREAM:
+				index++;
+				break;
+			
+			default:
+				return index;
+		}
+	}
+}
+
+// End the current transaction without touching the bus. In a batch the steps it had left are skipped and the next one waits for I2C_engine_resume().
+static void I2C_engine_close(uint8_t I2C_error){
+	I2C_engine_status |= I2C_error;
+	I2C_engine_stopped_at = TIMER_now();
+	I2C_engine_index = I2C_engine_transaction_end();
+	
+	if((I2C_engine_steps[I2C_engine_index] & I2C_OP_MASK) == I2C_OP_STOP){
+		I2C_engine_index++;
+		I2C_engine_phase = I2C_PHASE_STOPPED;
+		I2C_engine_state = I2C_ENGINE_STOPPED;
+	}
+	else{
+		I2C_engine_state = I2C_ENGINE_DONE;
+	}
+}
+
+static void I2C_engine_stop(uint8_t I2C_error){
+	I2C_engine_close(I2C_error);
+	TRACE_record(TRACE_STOP);
+	
+	// TWIE is left clear, which is how I2C_engine_poll() tells the transaction has ended
+	I2C_stop();
+}
+
+static void I2C_engine_transmit(uint8_t data){
+	I2C_engine_pec = CRC8_update(I2C_engine_pec, data);
+	STATS_count(STATS_BYTES_WRITTEN);
+	TWDR = data;
+	TWCR = I2C_ENGINE_CONTROL;
+}
+
+static void I2C_engine_write(){
+	I2C_engine_phase = I2C_PHASE_WRITE;
+	I2C_engine_remaining--;
+	I2C_engine_transmit(I2C_engine_steps[I2C_engine_index++]);
+}
+
+// Send the next fed byte, or hold the bus with TWINT set until I2C_engine_feed() brings one. Returns 0 once the stream has been closed and sent.
+static uint8_t I2C_engine_stream(){
+	I2C_engine_phase = I2C_PHASE_STREAM;
+	
+	if(I2C_stream_head != I2C_stream_tail){
+		I2C_engine_transmit(I2C_stream_buffer[I2C_stream_tail]);
+		I2C_stream_tail = (I2C_stream_tail + 1) & (I2C_STREAM_BUFFER_LENGTH - 1);
+		return 1;
+	}
+	
+	if(I2C_stream_closed) return 0;
+	
+	I2C_engine_state = I2C_ENGINE_STARVED;
+	TWCR = (1 << TWEN);
+	return 1;
+}
+
+// Clock in the next byte, ACKing it unless it is the last one. A block count is always ACK'd since the bytes it announces follow.
+static void I2C_engine_receive(){
+	I2C_engine_phase = I2C_PHASE_READ;
+	I2C_engine_acking = (I2C_engine_remaining > 1) || (I2C_engine_flags & I2C_FLAG_BLOCK);
+	TWCR = I2C_ENGINE_CONTROL | (I2C_engine_acking << TWEA);
+}
+
+// Issue the bus operation for the step at I2C_engine_index. status is the TWSR value the last operation left, so it is not read again.
+static void I2C_engine_next(uint8_t status){
+	uint8_t opcode;
+	
+	while(1){
+		I2C_engine_step = I2C_engine_index;
+		opcode = I2C_engine_steps[I2C_engine_index];
+		I2C_engine_flags = opcode & ~I2C_OP_MASK;
+		
+		switch(opcode & I2C_OP_MASK){
+			case I2C_OP_ADDRESS: // The address byte is sent once the START is out
+				TRACE_record(TRACE_START);
+				I2C_engine_phase = I2C_PHASE_START;
+				TWCR = I2C_ENGINE_CONTROL | (1 << TWSTA);
+				return;
+			
+			case I2C_OP_WRITE:
+				I2C_engine_remaining = I2C_engine_steps[I2C_engine_index + 1];
+				I2C_engine_index += 2;
+				
+				if(I2C_engine_remaining == 0) continue;
+				
+				I2C_engine_write();
+				return;
+			
+			case I2C_OP_STREAM:
+				I2C_engine_index++;
+				
+				if(I2C_engine_stream()) return;
+				continue;
+			
+			case I2C_OP_READ: // COUNT bytes plus the PEC, or for a block read the slave's count byte plus the PEC with COUNT as the limit (0 = 255)
+				if(opcode & I2C_FLAG_BLOCK){
+					I2C_engine_remaining = 1 + ((opcode & I2C_FLAG_PEC) != 0);
+					I2C_engine_block_limit = I2C_engine_steps[I2C_engine_index + 1] ? I2C_engine_steps[I2C_engine_index + 1] : 255;
+				}
+				else{
+					I2C_engine_remaining = I2C_engine_steps[I2C_engine_index + 1] + ((opcode & I2C_FLAG_PEC) != 0);
+				}
+				I2C_engine_index += 2;
+				
+				// Only an acknowledged SLA+R can be read from, which broadcast mode does not check for
+				if(status != 0x40) continue;
+				
+				// Exit if desired bytes to read back is zero to avoid a bus error.
+				if(I2C_engine_remaining == 0){
+					I2C_engine_stop((I2C_engine_options & I2C_ENGINE_CHECKED) ? I2C_NO_BYTES_REQUESTED : I2C_NO_ERROR);
+					return;
+				}
+				
+				I2C_engine_receive();
+				return;
+			
+			default: // END, or the I2C_OP_STOP after a transaction of a batch
+				I2C_engine_stop(I2C_NO_ERROR);
+				return;
+		}
+	}
+}
+
+// Only ever called with checked as a constant, so each call is inlined into a copy of its own with the other mode's tests folded away
+static inline __attribute__((always_inline)) void I2C_engine_interrupt(uint8_t checked, uint8_t status){
+	switch(I2C_engine_phase){
+		case I2C_PHASE_START:
+			// Check if the current I2C state matches START or repeated START
+			if(checked && (status != 0x08) && (status != 0x10)){
+				I2C_engine_stop(I2C_START_FAIL);
+				return;
+			}
+			
+			I2C_engine_phase = I2C_PHASE_ADDRESS;
+			I2C_engine_transmit(I2C_engine_steps[I2C_engine_index + 1]);
+			I2C_engine_index += 2;
+			return;
+		
+		case I2C_PHASE_ADDRESS:
+			if((status == 0x20) || (status == 0x48)) STATS_count(STATS_NACKS);
+			
+			// Check if the current I2C state matches SLA+W+ACK or SLA+R+ACK
+			if(checked && (status != 0x18) && (status != 0x40)){
+				I2C_engine_stop(I2C_ADDR_NACK);
+				return;
+			}
+			break;
+		
+		case I2C_PHASE_WRITE:
+			// Data byte ACKs are not checked, the slave answers for the whole write in its status
+			if(status == 0x30) STATS_count(STATS_NACKS);
+			
+			if(I2C_engine_remaining){
+				I2C_engine_write();
+				return;
+			}
+			
+			// The PEC goes out after the step's last byte and covers everything sent since the first START
+			if(I2C_engine_flags & I2C_FLAG_PEC){
+				I2C_engine_flags &= ~I2C_FLAG_PEC;
+				I2C_engine_transmit(I2C_engine_pec);
+				return;
+			}
+			break;
+		
+		case I2C_PHASE_STREAM:
+			// Unchecked like any other data byte, the next one goes out as soon as it has been fed
+			if(status == 0x30) STATS_count(STATS_NACKS);
+			
+			if(I2C_engine_stream()) return;
+			break;
+		
+		case I2C_PHASE_READ:
+			// Check that the byte was ACK'd, or NACK'd if it was the last one
+			if(checked && (status != (I2C_engine_acking ? 0x50 : 0x58))){
+				I2C_engine_stop(I2C_engine_acking ? I2C_DATA_READ_ACK_FAIL : I2C_DATA_READ_NACK_FAIL);
+				return;
+			}
+			
+			// Filler byte NACK'd to end an empty block read, it is not data
+			if(I2C_engine_remaining == 0) break;
+			
+			// Hold the bus with TWINT set until the main loop has sent what is buffered, this interrupt fires again on I2C_engine_resume()
+			if(!I2C_result_room()){
+				I2C_result_held = 1;
+				I2C_engine_state = I2C_ENGINE_FULL;
+				TWCR = (1 << TWEN);
+				return;
+			}
+			
+			I2C_result_buffer[I2C_result_length] = I2C_read();
+			I2C_engine_pec = CRC8_update(I2C_engine_pec, I2C_result_buffer[I2C_result_length]);
+			I2C_engine_remaining--;
+			STATS_count(STATS_BYTES_READ);
+			
+			// The first byte of a block read is the slave's count of the bytes that follow. A longer block than the limit is cut short and fails its PEC.
+			if(I2C_engine_flags & I2C_FLAG_BLOCK){
+				I2C_engine_flags &= ~I2C_FLAG_BLOCK;
+				I2C_engine_remaining += (I2C_result_buffer[I2C_result_length] < I2C_engine_block_limit) ? I2C_result_buffer[I2C_result_length] : I2C_engine_block_limit;
+			}
+			I2C_result_length++;
+			
+			if(I2C_engine_remaining){
+				I2C_engine_receive();
+				return;
+			}
+			
+			// Running the CRC over a correct PEC leaves zero behind. The PEC stays in the results for the host.
+			if((I2C_engine_flags & I2C_FLAG_PEC) && (I2C_engine_pec != 0)) I2C_engine_status |= I2C_PEC_FAIL;
+			
+			if(I2C_engine_options & I2C_ENGINE_MARK_READS) I2C_result_read_end[I2C_result_reads++] = I2C_result_length;
+			
+			// An empty block without PEC had its count ACK'd, so one more byte has to be clocked in and NACK'd
+			if(I2C_engine_acking){
+				I2C_engine_receive();
+				return;
+			}
+			break;
+		
+		default:
+			break;
+	}
+	
+	I2C_engine_next(status);
+}
+
+ISR(TWI_vect){
+	uint8_t status = I2C_get_status();
+	
+	I2C_engine_progress++;
+	TRACE_record(status);
+	
+	// Broadcast mode gets the unchecked copy, everything else the checked one. The mode is tested once here instead of at every check.
+	if(I2C_engine_options & I2C_ENGINE_CHECKED){
+		I2C_engine_interrupt(1, status);
+	}
+	else{
+		I2C_engine_interrupt(0, status);
+	}
+}
+
+// Start the transaction at I2C_engine_index, which is the first one of the program or follows an I2C_OP_STOP
+static void I2C_engine_begin(){
+	uint8_t *cached;
+	uint8_t cached_length = 0;
+	
+	I2C_engine_status = I2C_NO_ERROR;
+	I2C_engine_pec = 0;
+	I2C_operation_begin();
+	I2C_engine_started_at = TIMER_now();
+	I2C_engine_state = I2C_ENGINE_RUNNING;
+	I2C_engine_first = I2C_engine_index;
+	I2C_engine_cache_hit = 0;
+	I2C_result_first = I2C_result_length;
+	I2C_result_held = 0;
+	
+	// Only the first address is looked up, the steps before a later one may be what switches a mux to reach it
+	if((I2C_engine_options & I2C_ENGINE_PRESENCE) && ((I2C_engine_steps[I2C_engine_index] & I2C_OP_MASK) == I2C_OP_ADDRESS) && I2C_presence_absent(I2C_engine_steps[I2C_engine_index + 1] >> 1)){
+		I2C_engine_step = I2C_engine_index;
+		I2C_engine_close(I2C_ADDR_NACK);
+		I2C_engine_stopped_at = I2C_engine_started_at;
+		return;
+	}
+	
+	// A hit is put in the result buffer as if it had just been read, as long as there is room for the longest one
+	if((I2C_engine_options & I2C_ENGINE_CACHED) && (I2C_result_length <= (I2C_RESULT_BUFFER_LENGTH - CACHE_DATA_LENGTH)) && (I2C_result_reads < I2C_RESULT_READS)){
+		cached = CACHE_lookup(I2C_engine_steps + I2C_engine_index, &cached_length);
+		
+		if(cached){
+			for(uint8_t index = 0; index < cached_length; index++) I2C_result_buffer[I2C_result_length++] = cached[index];
+			if(I2C_engine_options & I2C_ENGINE_MARK_READS) I2C_result_read_end[I2C_result_reads++] = I2C_result_length;
+			
+			I2C_engine_cache_hit = 1;
+			I2C_engine_step = I2C_engine_index;
+			I2C_engine_close(I2C_NO_ERROR);
+			I2C_engine_stopped_at = I2C_engine_started_at;
+			return;
+		}
+	}
+	
+	// Nothing has happened on the bus yet, and a program that reads before its first address does not get to
+	I2C_engine_next(0xF8);
+}
+
+// The program is read as the bus goes, so it must be left alone until I2C_engine_finish() has returned the status of its last transaction
+void I2C_engine_start(uint8_t *program, uint8_t options){
+	I2C_engine_steps = program;
+	I2C_engine_options = options;
+	I2C_engine_index = 0;
+	I2C_stream_head = 0;
+	I2C_stream_tail = 0;
+	I2C_stream_closed = 0;
+	
+	I2C_engine_begin();
+}
+
+// Returns the engine state without blocking. Called in a loop it times every bus operation against the driver's deadline.
+uint8_t I2C_engine_poll(){
+	// A starved stream or a full result buffer holds SCL low with TWIE clear, which is timed like any other bus operation
+	uint8_t held = (I2C_engine_state == I2C_ENGINE_STARVED) || (I2C_engine_state == I2C_ENGINE_FULL);
+	uint8_t interrupt_state;
+	
+	// TWIE stays set for as long as the interrupt is driving the bus
+	if(!(TWCR & (1 << TWIE)) && !held) return I2C_engine_state;
+	
+	if(I2C_engine_progress != I2C_engine_progress_seen){
+		I2C_engine_progress_seen = I2C_engine_progress;
+		I2C_operation_begin();
+		return held ? I2C_engine_state : (uint8_t)I2C_ENGINE_RUNNING;
+	}
+	
+	if(!I2C_operation_expired()) return held ? I2C_engine_state : (uint8_t)I2C_ENGINE_RUNNING;
+	
+	// TWINT never came back, stop the interrupt before it can race the reset
+	interrupt_state = SREG;
+	cli();
+	if(I2C_engine_progress == I2C_engine_progress_seen){
+		TWCR = (1 << TWEN);
+		TRACE_record(TRACE_TIMEOUT);
+		I2C_engine_status |= I2C_BUS_RESET;
+		I2C_engine_state = I2C_ENGINE_DONE;
+		I2C_engine_stopped_at = TIMER_now();
+	}
+	SREG = interrupt_state;
+	
+	if(I2C_engine_status & I2C_BUS_RESET) I2C_reset_bus();
+	
+	return I2C_engine_state;
+}
+
+// Block until the transaction has ended or needs its results collected
+uint8_t I2C_engine_wait(){
+	uint8_t state;
+	
+	while((state = I2C_engine_poll()) == I2C_ENGINE_RUNNING);
+	
+	return state;
+}
+
+void I2C_engine_resume(){
+	// Between the transactions of a batch the bus is free, the next one starts with a START of its own
+	if(I2C_engine_phase == I2C_PHASE_STOPPED){
+		I2C_engine_begin();
+		return;
+	}
+	
+	I2C_engine_state = I2C_ENGINE_RUNNING;
+	TWCR = (1 << TWEN) | (1 << TWIE);
+}
+
+// Queue a byte for the stream step, returns 0 while the stream buffer is full. Bytes fed after the transaction has ended are dropped.
+uint8_t I2C_engine_feed(uint8_t data){
+	uint8_t next_head = (I2C_stream_head + 1) & (I2C_STREAM_BUFFER_LENGTH - 1);
+	
+	if((I2C_engine_state == I2C_ENGINE_IDLE) || (I2C_engine_state == I2C_ENGINE_DONE)) return 1;
+	if(next_head == I2C_stream_tail) return 0;
+	
+	I2C_stream_buffer[I2C_stream_head] = data;
+	I2C_stream_head = next_head;
+	
+	// The interrupt only goes hungry after seeing an empty buffer, so a byte queued before this check is never stranded
+	if(I2C_engine_state == I2C_ENGINE_STARVED) I2C_engine_resume();
+	
+	return 1;
+}
+
+// The stream step ends once everything fed has been sent
+void I2C_engine_feed_end(){
+	I2C_stream_closed = 1;
+	
+	if(I2C_engine_state == I2C_ENGINE_STARVED) I2C_engine_resume();
+}
+
+// Hands back the status of a finished transaction and frees the engine for the next one, or for the rest of the batch once I2C_engine_resume() is called
+uint8_t I2C_engine_finish(){
+	I2C_engine_state = I2C_ENGINE_IDLE;
+	
+	// Every transaction goes past the cache so writes can drop what they changed, and a read is only kept if all of it is still in the buffer
+	if(!I2C_engine_cache_hit){
+		CACHE_update(I2C_engine_steps + I2C_engine_first, I2C_engine_status, (uint8_t *)I2C_result_buffer + I2C_result_first, I2C_result_length - I2C_result_first, (I2C_engine_options & I2C_ENGINE_CACHED) && !I2C_result_held && (I2C_result_length >= I2C_result_first));
+	}
+	
+	STATS_count(STATS_TRANSACTIONS);
+	STATS_time(STATS_BUS, I2C_engine_stopped_at - I2C_engine_started_at);
+	
+	return I2C_engine_status;
+}
+
+uint8_t *I2C_result_data(uint16_t *length){
+	*length = I2C_result_length;
+	
+	return (uint8_t *)I2C_result_buffer;
+}
+
+void I2C_result_clear(){
+	I2C_result_length = 0;
+	I2C_result_reads = 0;
+}
+
+void I2C_presence_record(uint8_t address, uint8_t present){
+	uint8_t bit = 1 << (address & 0x07);
+	
+	I2C_presence_scanned[address >> 3] |= bit;
+	
+	if(present){
+		I2C_presence_found[address >> 3] |= bit;
+	}
+	else{
+		I2C_presence_found[address >> 3] &= ~bit;
+	}
+}
+
+// True only for an address that has been scanned and did not answer, anything never scanned is given the benefit of the doubt
+uint8_t I2C_presence_absent(uint8_t address){
+	uint8_t bit = 1 << (address & 0x07);
+	
+	return (I2C_presence_scanned[address >> 3] & bit) && !(I2C_presence_found[address >> 3] & bit);
+}
+
+// True only for an address that answered the last scan that covered it
+uint8_t I2C_presence_present(uint8_t address){
+	uint8_t bit = 1 << (address & 0x07);
+	
+	return (I2C_presence_scanned[address >> 3] & bit) && (I2C_presence_found[address >> 3] & bit);
+}
+
+// Send the buffered read data as hex, ending every completed read with a newline
+uint8_t I2C_result_emit(){
+	uint8_t system_status = NO_ERROR;
+	uint8_t read = 0;
+	
+	for(uint16_t result_index = 0; result_index < I2C_result_length; result_index++){
+		system_status |= UART_transmit_hex(I2C_result_buffer[result_index]);
+		
+		if((read < I2C_result_reads) && ((result_index + 1) == I2C_result_read_end[read])){
+			system_status |= UART_transmit('\n');
+			read++;
+		}
+	}
+	
+	I2C_result_clear();
+	
+	return system_status;
+}
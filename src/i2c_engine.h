@@ -0,0 +1,81 @@
+/*
+ * i2c_engine.h
+ *
+ * Created: 10/17/2026 11:02:37 AM
+ *  Author: aparady
+ */ 
+
+
+#ifndef I2C_ENGINE_H_
+#define I2C_ENGINE_H_
+
+#include <avr/io.h>
+
+/*
+Transactions run from the TWI interrupt. The caller builds a program, starts it, and is free to do other work until the STOP has been sent.
+Bytes read along the way are collected in the result buffer.
+
+A program is a list of steps ending in I2C_OP_END. Every step is an opcode byte, optionally OR'd with flags, followed by its operands.
+A batch is several transactions in one program separated by I2C_OP_STOP. The engine stops after each one so its results and status can be collected, and a failure only ends the transaction it happened in.
+*/
+
+#define I2C_PROGRAM_LENGTH 268 // Address, command code, 255 data bytes and PEC in one line, plus the step headers and room to detect an overflow
+
+enum I2C_PROGRAM_OPCODES{
+	I2C_OP_END					= 0x00,	// STOP
+	I2C_OP_ADDRESS					= 0x01,	// SLA: START or repeated START, then the address byte with R/W in bit 0
+	I2C_OP_WRITE					= 0x02,	// COUNT DATA...: Write COUNT data bytes
+	I2C_OP_READ					= 0x03,	// COUNT: Read COUNT bytes, ACKing all but the last. A block read takes its length from the slave, up to COUNT (0 = 255).
+	I2C_OP_STOP					= 0x04,	// STOP, then the steps after it run as a transaction of their own with their own status. Must be followed by an ADDRESS.
+	I2C_OP_STREAM					= 0x05,	// Write the bytes handed to I2C_engine_feed() as they come, holding the bus while none are waiting, until I2C_engine_feed_end()
+	I2C_OP_MASK					= 0x0F	// Opcode bits, the rest are I2C_PROGRAM_FLAGS
+};
+
+enum I2C_PROGRAM_FLAGS{
+	I2C_FLAG_PEC					= 0x10,	// A PEC byte follows the data
+	I2C_FLAG_BLOCK					= 0x20	// A block count byte precedes the data, only used on reads
+};
+
+enum I2C_ENGINE_OPTIONS{
+	I2C_ENGINE_CHECKED				= 0x01,	// Check TWSR after every step and stop at the first unexpected state, otherwise run blind like broadcast mode
+	I2C_ENGINE_MARK_READS				= 0x02,	// Remember where each read ends so the ASCII output can put a newline after it
+	I2C_ENGINE_PRESENCE				= 0x04,	// Fail with I2C_ADDR_NACK without touching the bus if the first address is one a scan found absent
+	I2C_ENGINE_CACHED				= 0x08	// Answer a read the cache holds from SRAM without touching the bus, and keep the ones it is allowed to
+};
+
+enum I2C_ENGINE_STATES{
+	I2C_ENGINE_IDLE					= 0x00,	// Nothing to collect
+	I2C_ENGINE_RUNNING				= 0x01,	// Transaction is on the bus
+	I2C_ENGINE_FULL					= 0x02,	// Bus is held until the result buffer has been sent and I2C_engine_resume() is called
+	I2C_ENGINE_DONE					= 0x03,	// STOP has been issued, the status is waiting in I2C_engine_finish()
+	I2C_ENGINE_STOPPED				= 0x04,	// Same for a transaction followed by an I2C_OP_STOP, I2C_engine_resume() starts the next one after I2C_engine_finish()
+	I2C_ENGINE_STARVED				= 0x05	// Bus is held in a stream step until I2C_engine_feed() brings the next byte
+};
+
+void I2C_engine_start(uint8_t *program, uint8_t options);
+
+uint8_t I2C_engine_poll();
+
+uint8_t I2C_engine_wait();
+
+void I2C_engine_resume();
+
+uint8_t I2C_engine_feed(uint8_t data);
+
+void I2C_engine_feed_end();
+
+uint8_t I2C_engine_finish();
+
+uint8_t *I2C_result_data(uint16_t *length);
+
+void I2C_result_clear();
+
+uint8_t I2C_result_emit();
+
+void I2C_presence_record(uint8_t address, uint8_t present);
+
+uint8_t I2C_presence_absent(uint8_t address);
+
+uint8_t I2C_presence_present(uint8_t address);
+
+#endif /* I2C_ENGINE_H_ */
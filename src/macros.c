@@ -0,0 +1,108 @@
+/*
+ * macros.c
+ *
+ * Created: 10/17/2026 6:31:15 PM
+ *  Author: aparady
+ */ 
+
+#ifndef F_CPU
+#warning "F_CPU not defined!"
+
+#define F_CPU 16000000UL
+#endif
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "macros.h"
+#include "i2c_engine.h"
+
+static uint8_t MACRO_formatted = 0; // The EEPROM holds this table, anything else there is left alone until the first store
+
+// Where an entry's length byte lives, its program follows it. The table starts after the magic byte.
+static uint8_t *MACRO_eeprom(uint8_t entry){
+	return (uint8_t *)(uintptr_t)(MACRO_EEPROM_BASE + 1 + (entry * (MACRO_PROGRAM_LENGTH + 1)));
+}
+
+// True for a program the engine can run as it is: it starts with an address, every step fits in front of the END it finishes with, and it reads at most MACRO_READ_LENGTH bytes.
+// The read total counts the status and length a batch answers with for every transaction, and the worst case of a block read.
+static uint8_t MACRO_valid(uint8_t *program, uint16_t length){
+	uint16_t index = 0;
+	uint16_t total = 2;
+	
+	if((length < 3) || (length > MACRO_PROGRAM_LENGTH) || (program[0] != I2C_OP_ADDRESS) || (program[length - 1] != I2C_OP_END)) return 0;
+	
+	while(index < (length - 1)){
+		switch(program[index] & I2C_OP_MASK){
+			case I2C_OP_ADDRESS:
+				index += 2;
+				break;
+			
+			case I2C_OP_WRITE:
+				index += 2 + program[index + 1];
+				break;
+			
+			case I2C_OP_READ:
+				total += ((program[index] & I2C_FLAG_BLOCK) && (program[index + 1] == 0)) ? 255 : program[index + 1];
+				total += ((program[index] & I2C_FLAG_BLOCK) != 0) + ((program[index] & I2C_FLAG_PEC) != 0);
+				index += 2;
+				break;
+			
+			case I2C_OP_STOP:
+				if(program[index + 1] != I2C_OP_ADDRESS) return 0;
+				
+				total += 2;
+				index++;
+				break;
+			
+			default: // An END before the last byte, or a stream, which has no place in a stored program
+				return 0;
+		}
+	}
+	
+	return (index == (length - 1)) && (total <= MACRO_READ_LENGTH);
+}
+
+// EEPROM that has never held the table, erased or left by another sketch, has no magic byte and every entry starts free
+void MACRO_init(){
+	MACRO_formatted = (eeprom_read_byte((uint8_t *)MACRO_EEPROM_BASE) == MACRO_MAGIC);
+}
+
+// Keep a finished program as entry, or free the entry with a length of 0. Returns the entry or MACRO_NONE if the program does not fit.
+// Storing what is already there leaves the EEPROM alone. Otherwise the length byte is written last, so power going away in the middle leaves the entry free rather than half written.
+uint8_t MACRO_store(uint8_t entry, uint8_t *program, uint16_t length){
+	uint8_t changed = 0;
+	
+	if(entry >= MACRO_ENTRIES) return MACRO_NONE;
+	if((length != 0) && !MACRO_valid(program, length)) return MACRO_NONE;
+	
+	// The first store frees every entry before the magic byte goes in, so nothing that was in the EEPROM before is taken for a macro
+	if(!MACRO_formatted){
+		for(uint8_t other = 0; other < MACRO_ENTRIES; other++) eeprom_update_byte(MACRO_eeprom(other), 0);
+		eeprom_update_byte((uint8_t *)MACRO_EEPROM_BASE, MACRO_MAGIC);
+		MACRO_formatted = 1;
+	}
+	
+	changed = (eeprom_read_byte(MACRO_eeprom(entry)) != length);
+	for(uint8_t index = 0; index < length; index++) changed |= (eeprom_read_byte(MACRO_eeprom(entry) + 1 + index) != program[index]);
+	
+	if(!changed) return entry;
+	
+	eeprom_update_byte(MACRO_eeprom(entry), 0);
+	eeprom_update_block(program, MACRO_eeprom(entry) + 1, length);
+	eeprom_update_byte(MACRO_eeprom(entry), length);
+	
+	return entry;
+}
+
+// Read entry with its END into program, which must have room for MACRO_PROGRAM_LENGTH bytes. Returns 0 for a free entry, or one that does not hold a valid program, like one from a save cut short.
+uint8_t MACRO_load(uint8_t entry, uint8_t *program, uint16_t *length){
+	if((entry >= MACRO_ENTRIES) || !MACRO_formatted) return 0;
+	
+	*length = eeprom_read_byte(MACRO_eeprom(entry));
+	if((*length == 0) || (*length > MACRO_PROGRAM_LENGTH)) return 0;
+	
+	eeprom_read_block(program, MACRO_eeprom(entry) + 1, *length);
+	
+	return MACRO_valid(program, *length);
+}
@@ -0,0 +1,33 @@
+/*
+ * macros.h
+ *
+ * Created: 10/17/2026 6:31:15 PM
+ *  Author: aparady
+ */ 
+
+
+#ifndef MACROS_H_
+#define MACROS_H_
+
+#include <avr/io.h>
+
+/*
+Transaction programs kept in the ATmega328P's EEPROM under a number, so a line the host sends over and over is parsed once and then run by number.
+The table starts with MACRO_MAGIC at MACRO_EEPROM_BASE, then every entry is a length byte followed by the program, back to back. An entry is read straight into the program being built whenever it runs, so the table takes no SRAM, and is only written when it changes.
+Nothing read from the EEPROM is trusted, an entry is only run if it is a whole program that fits the limits a store would have checked.
+*/
+
+#define MACRO_ENTRIES 8
+#define MACRO_PROGRAM_LENGTH 23 // With its length byte an entry takes 24 bytes of EEPROM, enough for a page select and a read with PEC
+#define MACRO_READ_LENGTH 64 // Most bytes a macro may read, so a binary run always fits in one frame
+#define MACRO_EEPROM_BASE 0x000
+#define MACRO_MAGIC 0xA1 // First byte of the table, changes whenever the layout does
+#define MACRO_NONE 0xFF // No entry
+
+void MACRO_init();
+
+uint8_t MACRO_store(uint8_t entry, uint8_t *program, uint16_t length);
+
+uint8_t MACRO_load(uint8_t entry, uint8_t *program, uint16_t *length);
+
+#endif /* MACROS_H_ */
@@ -0,0 +1,114 @@
+/*
+ * poller.c
+ *
+ * Created: 10/17/2026 2:07:19 PM
+ *  Author: aparady
+ */ 
+
+#ifndef F_CPU
+#warning "F_CPU not defined!"
+
+#define F_CPU 16000000UL
+#endif
+
+#include <avr/io.h>
+
+#include "poller.h"
+#include "i2c_engine.h"
+#include "arduino_drivers.h"
+
+static uint8_t POLL_programs[POLL_ENTRIES][POLL_PROGRAM_LENGTH];
+static uint16_t POLL_periods[POLL_ENTRIES]; // Milliseconds, 0 marks a free entry
+static uint32_t POLL_due[POLL_ENTRIES]; // TIMER_now() tick of the next sample
+
+// Bytes a program reads in the worst case, which for a block read is its limit plus the count byte
+static uint16_t POLL_read_length(uint8_t *program, uint16_t length){
+	uint16_t index = 0;
+	uint16_t total = 0;
+	
+	while((index < length) && (program[index] != I2C_OP_END)){
+		switch(program[index] & I2C_OP_MASK){
+			case I2C_OP_ADDRESS:
+				index += 2;
+				break;
+			
+			case I2C_OP_WRITE:
+				index += 2 + program[index + 1];
+				break;
+			
+			case I2C_OP_READ:
+				total += ((program[index] & I2C_FLAG_BLOCK) && (program[index + 1] == 0)) ? 255 : program[index + 1];
+				total += ((program[index] & I2C_FLAG_BLOCK) != 0) + ((program[index] & I2C_FLAG_PEC) != 0);
+				index += 2;
+				break;
+			
+			default:
+				return 0xFFFF;
+		}
+	}
+	
+	return total;
+}
+
+// Copy a finished program into a free entry, which is first due right away. Returns the entry or POLL_NONE if it does not fit.
+uint8_t POLL_add(uint8_t *program, uint16_t length, uint16_t period){
+	uint8_t entry = 0;
+	
+	if((period == 0) || (length > POLL_PROGRAM_LENGTH) || (program[0] != I2C_OP_ADDRESS)) return POLL_NONE;
+	if(POLL_read_length(program, length) > POLL_READ_LENGTH) return POLL_NONE;
+	
+	while((entry < POLL_ENTRIES) && (POLL_periods[entry] != 0)) entry++;
+	if(entry == POLL_ENTRIES) return POLL_NONE;
+	
+	for(uint8_t index = 0; index < length; index++) POLL_programs[entry][index] = program[index];
+	
+	POLL_periods[entry] = period;
+	POLL_due[entry] = TIMER_now();
+	
+	return entry;
+}
+
+// Free an entry, or all of them with POLL_NONE. Returns how many entries are still scheduled.
+uint8_t POLL_remove(uint8_t entry){
+	uint8_t scheduled = 0;
+	
+	for(uint8_t index = 0; index < POLL_ENTRIES; index++){
+		if((entry == POLL_NONE) || (entry == index)) POLL_periods[index] = 0;
+		
+		scheduled += (POLL_periods[index] != 0);
+	}
+	
+	return scheduled;
+}
+
+// The entry that has been due the longest, or is due soonest, and when. Returns POLL_NONE if nothing is scheduled.
+uint8_t POLL_next(uint32_t *due){
+	uint32_t now = TIMER_now();
+	uint8_t next = POLL_NONE;
+	
+	for(uint8_t entry = 0; entry < POLL_ENTRIES; entry++){
+		if(POLL_periods[entry] == 0) continue;
+		
+		// Compared as distances from now so the tick count wrapping around does not reorder anything
+		if((next == POLL_NONE) || ((int32_t)(POLL_due[entry] - now) < (int32_t)(POLL_due[next] - now))) next = entry;
+	}
+	
+	if(next != POLL_NONE) *due = POLL_due[next];
+	
+	return next;
+}
+
+// Move an entry that is being sampled at now on to its next period. Periods that had already gone by are skipped and returned as the overrun count.
+uint8_t POLL_advance(uint8_t entry, uint32_t now){
+	uint32_t period = (uint32_t)POLL_periods[entry] * TIMER_TICKS_PER_MS;
+	uint32_t missed = (now - POLL_due[entry]) / period;
+	
+	// Stepping from the old due time keeps the samples on their original phase
+	POLL_due[entry] += (missed + 1) * period;
+	
+	return (missed > 0xFF) ? 0xFF : missed;
+}
+
+uint8_t *POLL_program(uint8_t entry){
+	return POLL_programs[entry];
+}
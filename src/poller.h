@@ -0,0 +1,34 @@
+/*
+ * poller.h
+ *
+ * Created: 10/17/2026 2:07:19 PM
+ *  Author: aparady
+ */ 
+
+
+#ifndef POLLER_H_
+#define POLLER_H_
+
+#include <avr/io.h>
+
+/*
+A schedule of transaction programs, each repeated at its own period in milliseconds on the Timer1 tick.
+The table only keeps time; running a due entry and sending its sample is left to the command interpreter, which does it between command lines.
+*/
+
+#define POLL_ENTRIES 8
+#define POLL_PROGRAM_LENGTH 12 // Enough for a command code write and a read with PEC, the usual PMBus telemetry read
+#define POLL_READ_LENGTH 32 // Most bytes one sample may read, so it always fits in a binary frame next to its header
+#define POLL_NONE 0xFF // No entry, or every entry when removing
+
+uint8_t POLL_add(uint8_t *program, uint16_t length, uint16_t period);
+
+uint8_t POLL_remove(uint8_t entry);
+
+uint8_t POLL_next(uint32_t *due);
+
+uint8_t POLL_advance(uint8_t entry, uint32_t now);
+
+uint8_t *POLL_program(uint8_t entry);
+
+#endif /* POLLER_H_ */
@@ -13,203 +13,815 @@
 
 #include <avr/io.h>
 #include <util/delay.h>
+#include <avr/pgmspace.h>
 
 #include "ctype.h"
+#include "string.h"
 #include "smbus_bridge.h"
 #include "arduino_drivers.h"
 #include "arduino_errors.h"
+#include "binary_protocol.h"
+#include "i2c_engine.h"
+#include "poller.h"
+#include "stats.h"
+#include "i2c_eeprom.h"
+#include "trace.h"
+#include "macros.h"
+#include "cache.h"
+
+#define I2C_PROGRAMS 2 // One program can be on the bus while the next line is parsed into the other. Each is half the size of the old 16 bit line buffer, the SRAM that saved went to the second one.
+#define I2C_GATHER_DEVICES 24 // Each device of a gather takes 10 program bytes, this many fit in one program with its END
+#define I2C_ALERT_RESPONSE_ADDRESS 0x0C // SMBus Alert Response Address, read by the master to find out who pulled SMBALERT# low
+#define I2C_ALERT_RESPONSES 8 // Devices reported per SMBALERT# edge, so one that keeps the line low while answering cannot hold up the host
+#define PMBUS_STATUS_WORD 0x79
 
 uint8_t broadcast_flag = 0; // If this flag is not zero then the I2C interpreter will not check for an ACK from the slave device when transmitting
+uint8_t binary_flag = 0; // If this flag is not zero then commands arrive and responses leave as binary frames instead of ASCII
 
-uint8_t display_help(){
-	uint8_t system_status = NO_ERROR;
+static uint8_t I2C_programs[I2C_PROGRAMS][I2C_PROGRAM_LENGTH];
+static uint8_t I2C_program_select = 0; // Program being built, the other one may still be running
+static uint16_t I2C_program_length = 0;
+static uint16_t I2C_program_write_count = 0; // Index of the open write step's count byte, 0 when no write step is open
+static uint8_t I2C_program_read_next = 0; // The next data byte is the byte count of a read
+static uint8_t I2C_program_read_last = 0; // The last step is a read, which a stream cannot follow
+static uint8_t I2C_program_transactions = 0; // Transactions in the program being built, more than one makes it a batch
+static uint8_t I2C_program_separated = 1; // Nothing has been added since the start of the program or the last separator. A read count can have the same value as I2C_OP_STOP, so the last byte cannot tell.
+static uint8_t I2C_collect_batch = 0; // The program on the bus is a batch, so every transaction answers with its own status
+
+static uint16_t poll_until_interval = 10; // Milliseconds between reads of an X command, and how long it keeps trying
+static uint16_t poll_until_timeout = 1000;
+
+static uint8_t alert_mode = I2C_ALERT_OFF;
+
+static uint8_t eeprom_address_bytes = 2; // EEPROM geometry for the G and J commands
+static uint16_t eeprom_page_size = 32;
+
+static uint32_t command_started_at = 0; // TIMER_now() when the first byte of the line or frame being handled was seen
+
+// Mode change answers, kept in flash like the help text
+static const char enabled_message[] PROGMEM = "Broadcast Mode Enabled!\n";
+static const char disabled_message[] PROGMEM = "Broadcast Mode Disabled!\n";
+static const char binary_message[] PROGMEM = "Binary Mode Enabled!\n";
+
+// Programs are built one address or data byte at a time, in the order they appear on the command line
+static void I2C_program_begin(){
+	I2C_program_length = 0;
+	I2C_program_write_count = 0;
+	I2C_program_read_next = 0;
+	I2C_program_read_last = 0;
+	I2C_program_transactions = 0;
+	I2C_program_separated = 1;
+}
+
+// Largest single addition is a new write step, which still has to leave room for the END
+static uint8_t I2C_program_room(){
+	return I2C_program_length <= (I2C_PROGRAM_LENGTH - 4);
+}
+
+static void I2C_program_address(uint8_t address_byte){
+	uint8_t *program = I2C_programs[I2C_program_select];
 	
-	uint8_t help_index = 0;
-	uint8_t help[] = "I2C Dongle | XX = Hex Addr/Data | XX! = Start + Addr + W | XX? = Start + Addr + R | XX$ = Write Data Byte or ACKs | @ = Find Slave Addresses | ^ = Current I2C Bus State | T = 400kHz | S = 100kHz | V = 10kHz | % = Current Bus Frequency\n";
+	// The first address of the line and the first one after a separator each start a transaction
+	if(I2C_program_separated) I2C_program_transactions++;
 	
-	while(help[help_index] != '\0'){
-		system_status |= UART_transmit(help[help_index]);
-		help_index++;
-		_delay_us(10);
+	program[I2C_program_length++] = I2C_OP_ADDRESS;
+	program[I2C_program_length++] = address_byte;
+	
+	I2C_program_write_count = 0;
+	I2C_program_read_next = address_byte & 0x01;
+	I2C_program_read_last = 0;
+	I2C_program_separated = 0;
+}
+
+// The byte after an SLA+R is the read count, any other data byte joins the open write step or opens a new one
+static void I2C_program_data(uint8_t data, uint8_t flags){
+	uint8_t *program = I2C_programs[I2C_program_select];
+	
+	I2C_program_separated = 0;
+	
+	if(I2C_program_read_next){
+		program[I2C_program_length++] = I2C_OP_READ | flags;
+		program[I2C_program_length++] = data;
+		
+		I2C_program_read_next = 0;
+		I2C_program_read_last = 1;
+		return;
 	}
 	
-	return system_status;
+	I2C_program_read_last = 0;
+	
+	if((I2C_program_write_count == 0) || (program[I2C_program_write_count] == 0xFF)){
+		program[I2C_program_length++] = I2C_OP_WRITE;
+		I2C_program_write_count = I2C_program_length;
+		program[I2C_program_length++] = 0;
+	}
+	
+	program[I2C_program_length++] = data;
+	program[I2C_program_write_count]++;
+	
+	// Flags describe what follows the step's last byte, so a flagged byte closes its write step
+	if(flags){
+		program[I2C_program_write_count - 1] |= flags;
+		I2C_program_write_count = 0;
+	}
 }
 
-uint8_t I2C_scan_addresses(){
-	uint8_t I2C_status = NO_ERROR;
+// End the transaction being built with a STOP, the next address starts another one. Nothing happens before the first address or right after a STOP.
+static void I2C_program_separate(){
+	uint8_t *program = I2C_programs[I2C_program_select];
+	
+	if(I2C_program_separated) return;
+	
+	program[I2C_program_length++] = I2C_OP_STOP;
+	
+	I2C_program_write_count = 0;
+	I2C_program_read_next = 0;
+	I2C_program_read_last = 0;
+	I2C_program_separated = 1;
+}
+
+// Close the program being built with its END, returns its length
+static uint16_t I2C_program_end(){
+	// A separator at the very end has no transaction after it
+	if((I2C_program_length != 0) && I2C_program_separated) I2C_program_length--;
+	
+	I2C_programs[I2C_program_select][I2C_program_length++] = I2C_OP_END;
+	
+	return I2C_program_length;
+}
+
+// Load a stored macro as the program being built, less its END so the rest of the line can still add to it. Every address step for the macro's first device is pointed at address instead, unless it is 0xFF.
+// Returns 0 if the entry is free.
+static uint8_t I2C_program_macro(uint8_t entry, uint8_t address){
+	uint8_t *program = I2C_programs[I2C_program_select];
+	uint16_t length = 0;
+	uint8_t device = 0;
+	uint8_t transaction_start = 1;
+	uint16_t step = 0;
+	
+	I2C_program_begin();
+	
+	if(!MACRO_load(entry, program, &length)) return 0;
+	
+	device = program[1] >> 1;
 	
-	// From 0x00 to 0x7F, which is 128 values
-	for (int address = 0; address < 129; address++){
-		I2C_start();
-		if((I2C_status |= I2C_timeout()) != I2C_NO_ERROR) break;
+	while(I2C_program_length < (length - 1)){
+		I2C_program_read_last = ((program[I2C_program_length] & I2C_OP_MASK) == I2C_OP_READ);
 		
-		// Check if the current I2C state matches START or repeated START
-		if((I2C_get_status() != 0x08) && (I2C_get_status() != 0x10)){
-			I2C_status |= I2C_START_FAIL;
-			break;
+		switch(program[I2C_program_length] & I2C_OP_MASK){
+			case I2C_OP_ADDRESS:
+				I2C_program_transactions += transaction_start;
+				transaction_start = 0;
+				
+				if((address != 0xFF) && ((program[I2C_program_length + 1] >> 1) == device)) program[I2C_program_length + 1] = (address << 1) | (program[I2C_program_length + 1] & 0x01);
+				step = 2;
+				break;
+			
+			case I2C_OP_WRITE:
+				step = 2 + program[I2C_program_length + 1];
+				break;
+			
+			case I2C_OP_READ:
+				step = 2;
+				break;
+			
+			default: // STOP, the next address starts another transaction
+				transaction_start = 1;
+				step = 1;
+				break;
 		}
 		
-		I2C_write(address << 1);
-		if((I2C_status |= I2C_timeout()) != I2C_NO_ERROR) break;
-		
-		// Check if the current I2C state matches SLA+W+ACK or SLA+W+NACK
-		if((I2C_get_status() != 0x18) && (I2C_get_status() != 0x20)){
-			I2C_status |= I2C_ADDR_NACK;
-			break;
+		// MACRO_load() has checked the steps, this keeps a bad one from running the walk off the end of the program all the same
+		if((I2C_program_length + step) > (length - 1)){
+			I2C_program_begin();
+			return 0;
 		}
 		
-		// Find devices connected to i2c bus
-		if (I2C_get_status() == 0x18){
-			system_error_handler(UART_transmit_hex(address));
+		I2C_program_length += step;
+	}
+	
+	I2C_program_separated = 0;
+	
+	return 1;
+}
+
+// Finish the program being built and put it on the bus, the next one is built in the other buffer
+static void I2C_program_start(uint8_t options){
+	I2C_program_end();
+	
+	STATS_time(STATS_PARSE, TIMER_now() - command_started_at);
+	I2C_engine_start(I2C_programs[I2C_program_select], options);
+	I2C_program_select = (I2C_program_select + 1) % I2C_PROGRAMS;
+}
+
+// Take the next pair of hex digits off a data line, anything else in between is skipped. Returns 0 at the newline.
+static uint8_t UART_receive_pair(uint8_t *data){
+	char UART_data = '\0';
+	uint8_t digits = 0;
+	
+	while(digits < 2){
+		// A stream holds the bus while the host is quiet, so the engine is still timed between bytes
+		while(!UART_available()){
+			I2C_engine_poll();
+			UART_wait(TIMER_now() + TIMER_TICKS_PER_MS);
 		}
+		
+		UART_data = toupper(UART_receive());
+		
+		if(UART_data == '\n') return 0;
+		if(!isxdigit(UART_data)) continue;
+		
+		*data = (*data * 16) + (isdigit(UART_data) ? (UART_data - 48) : (UART_data - 55));
+		digits++;
 	}
 	
-	I2C_stop();
-	I2C_release_bus();
+	return 1;
+}
+
+// Start the program built so far with a stream step at its end and feed it the hex byte pairs on the rest of the line as they arrive.
+// The bus only ever waits on the host here, and XOFF holds the host back while the bus catches up.
+static void I2C_stream_line(uint8_t options){
+	uint8_t data = 0;
 	
-	return I2C_status;
+	I2C_programs[I2C_program_select][I2C_program_length++] = I2C_OP_STREAM;
+	I2C_program_start(options);
+	UART_set_flow_control(1);
+	
+	while(UART_receive_pair(&data)){
+		while(!I2C_engine_feed(data)) I2C_engine_poll();
+	}
+	
+	I2C_engine_feed_end();
+	UART_set_flow_control(0);
 }
 
-void I2C_broadcast(uint16_t *data_array){
-	for(int16_t receive_index = 1; receive_index < data_array[0]; receive_index++){
+// Send a string kept in flash
+static uint8_t UART_transmit_flash(const char *text){
+	uint8_t system_status = NO_ERROR;
+	
+	while(pgm_read_byte(text) != '\0') system_status |= UART_transmit(pgm_read_byte(text++));
+	
+	return system_status;
+}
+
+// Send the low digits of a value as hex, most significant first and without the data byte marker
+static uint8_t UART_transmit_digits(uint32_t value, uint8_t digits){
+	uint8_t system_status = NO_ERROR;
+	
+	while(digits--){
+		uint8_t nibble = (value >> (digits * 4)) & 0x0F;
 		
-		// If the data byte is greater than 1000, then the data byte refers to the address of the slave
-		if (data_array[receive_index] > 1000){
-			I2C_start();
-			if(I2C_timeout() & I2C_BUS_RESET) break;
-			
-			I2C_write(data_array[receive_index] - 1000);
-			if(I2C_timeout() & I2C_BUS_RESET) break;
+		system_status |= UART_transmit((nibble < 10) ? ('0' + nibble) : ('A' - 10 + nibble));
+	}
+	
+	return system_status;
+}
+
+// Let the transaction running in the background finish, sending its results as they come, and fold its status into the bus state.
+// Each transaction of a batch ends its results with ; and its own status instead, and only a bus reset carries over into the bus state.
+static uint8_t I2C_collect(uint8_t I2C_status){
+	uint32_t collect_started_at = TIMER_now();
+	uint8_t state = I2C_engine_wait();
+	uint8_t transaction_status = I2C_NO_ERROR;
+	
+	while(state != I2C_ENGINE_IDLE){
+		// The bus is held while a read that outgrew the result buffer is sent
+		if(state == I2C_ENGINE_FULL){
+			system_error_handler(I2C_result_emit());
+			I2C_engine_resume();
+			state = I2C_engine_wait();
+			continue;
 		}
 		
+		transaction_status = I2C_engine_finish();
+		
+		STATS_drain_begin();
+		system_error_handler(I2C_result_emit());
+		
+		if(I2C_collect_batch){
+			system_error_handler(UART_transmit(';'));
+			system_error_handler(UART_transmit_digits(transaction_status, 2));
+			system_error_handler(UART_transmit('\n'));
+			
+			I2C_status |= transaction_status & I2C_BUS_RESET;
+		}
 		else{
-			// If SLA+R was transmitted and an ACK was received, then the next data byte should be interpreted as the number of bytes to ACK.
-			if (I2C_get_status() == 0x40){
-				
-				// Exit if desired bytes to read back is zero to avoid a bus error.
-				if (data_array[receive_index] == 0){
-					break;
-				}
-				
-				// Send ACKs based on data byte value, but send a NACK on the last transmission.
-				while(data_array[receive_index] > 1){
-					I2C_ACK();
-					if(I2C_timeout() & I2C_BUS_RESET) break;
-					
-					system_error_handler(UART_transmit_hex(I2C_read()));
-					
-					data_array[receive_index]--;
-				}
-				I2C_NACK();
-				if(I2C_timeout() & I2C_BUS_RESET) break;
-				
-				system_error_handler(UART_transmit_hex(I2C_read()));
-				system_error_handler(UART_transmit('\n'));
-			}
-			else{
-				I2C_write(data_array[receive_index]);
-				if(I2C_timeout() & I2C_BUS_RESET) break;
-			}
+			I2C_status |= transaction_status;
 		}
+		STATS_drain_queued();
+		
+		if(state != I2C_ENGINE_STOPPED) break;
+		
+		I2C_engine_resume();
+		state = I2C_engine_wait();
 	}
-	I2C_stop();
-	I2C_release_bus();
+	
+	// Waiting on the previous line is bus and drain time, so the line being parsed around it does not count it as parse time
+	command_started_at += TIMER_now() - collect_started_at;
+	
+	return I2C_status;
 }
 
-uint8_t I2C_arbitration(uint16_t *data_array){
+// Program the EEPROM addressed at the start of the line from memory_address with the hex byte pairs on the rest of it, answering with how many bytes went in and = if that was all of them
+static uint8_t I2C_eeprom_line(uint16_t memory_address, uint8_t verify){
 	uint8_t I2C_status = I2C_NO_ERROR;
+	uint8_t data = 0;
+	
+	I2C_eeprom_begin(I2C_programs[I2C_program_select], I2C_programs[I2C_program_select][1] >> 1, eeprom_address_bytes, eeprom_page_size, memory_address, verify);
+	UART_set_flow_control(1);
 	
-	for(int16_t receive_index = 1; receive_index < data_array[0]; receive_index++){
+	// After a failure the rest of the line is still taken in, and thrown away
+	while(UART_receive_pair(&data)) I2C_eeprom_write(data);
+	
+	UART_set_flow_control(0);
+	I2C_status = I2C_eeprom_end();
+	
+	system_error_handler(UART_transmit_digits(I2C_eeprom_written(), 4));
+	system_error_handler(UART_transmit(((I2C_status == I2C_NO_ERROR) && I2C_eeprom_matched()) ? '=' : '!'));
+	system_error_handler(UART_transmit('\n'));
+	
+	return I2C_status;
+}
+
+// Collect the write addresses on the line into devices, returns how many or 0xFF if the line holds any other step or too many of them
+static uint8_t I2C_gather_line(uint8_t *devices){
+	uint8_t *program = I2C_programs[I2C_program_select];
+	uint8_t count = 0;
+	
+	for(uint16_t index = 0; index < I2C_program_length; index += 2){
+		if((program[index] != I2C_OP_ADDRESS) || (program[index + 1] & 0x01) || (count == I2C_GATHER_DEVICES)) return 0xFF;
 		
-		// If the data byte is greater than 1000, then the data byte refers to the address of the slave
-		if (data_array[receive_index] > 1000){
-			I2C_start();
-			if((I2C_status |= I2C_timeout()) & I2C_BUS_RESET) break;
-			
-			// Check if the current I2C state matches START or repeated START
-			if((I2C_get_status() != 0x08) && (I2C_get_status() != 0x10)){
-				I2C_status |= I2C_START_FAIL;
-				break;
-			}
+		devices[count++] = program[index + 1] >> 1;
+	}
+	
+	return count;
+}
+
+// Every device the last scans found, lowest address first
+static uint8_t I2C_gather_found(uint8_t *devices){
+	uint8_t count = 0;
+	
+	for(uint8_t address = 0; (address < 0x80) && (count < I2C_GATHER_DEVICES); address++){
+		if(I2C_presence_present(address)) devices[count++] = address;
+	}
+	
+	return count;
+}
+
+// Read length bytes of command from every device back to back, one transaction each so a device that fails does not cost the others their reads
+static void I2C_gather_start(uint8_t *devices, uint8_t count, uint8_t command, uint8_t length){
+	I2C_program_begin();
+	
+	for(uint8_t index = 0; index < count; index++){
+		I2C_program_address(devices[index] << 1);
+		I2C_program_data(command, 0);
+		I2C_program_address((devices[index] << 1) | 0x01);
+		I2C_program_data(length, 0);
+		I2C_program_separate();
+	}
+	
+	I2C_program_start((broadcast_flag == 0) ? (I2C_ENGINE_CHECKED | I2C_ENGINE_PRESENCE | I2C_ENGINE_CACHED) : 0);
+}
+
+// Run a gather and answer on one line with every device's address, status and bytes, ; between devices. Only a bus reset carries over into the bus state.
+static uint8_t I2C_gather_report(uint8_t I2C_status, uint8_t *devices, uint8_t count, uint8_t command, uint8_t length){
+	uint8_t state = I2C_ENGINE_IDLE;
+	uint8_t transaction_status = I2C_NO_ERROR;
+	uint8_t *result;
+	uint16_t result_length = 0;
+	
+	if(count != 0) I2C_gather_start(devices, count, command, length);
+	
+	STATS_drain_begin();
+	
+	for(uint8_t index = 0; index < count; index++){
+		state = I2C_engine_wait();
+		transaction_status = I2C_engine_finish();
+		I2C_status |= transaction_status & I2C_BUS_RESET;
+		
+		if(index != 0) system_error_handler(UART_transmit(';'));
+		system_error_handler(UART_transmit_digits(devices[index], 2));
+		system_error_handler(UART_transmit(' '));
+		system_error_handler(UART_transmit_digits(transaction_status, 2));
+		
+		result = I2C_result_data(&result_length);
+		if(result_length != 0) system_error_handler(UART_transmit(' '));
+		for(uint16_t byte = 0; byte < result_length; byte++) system_error_handler(UART_transmit_hex(result[byte]));
+		I2C_result_clear();
+		
+		if(state != I2C_ENGINE_STOPPED) break;
+		
+		I2C_engine_resume();
+	}
+	
+	system_error_handler(UART_transmit('\n'));
+	STATS_drain_queued();
+	
+	return I2C_status;
+}
+
+// Run a scheduled poll and stream its sample. The outcome only goes in the sample, a device that stops answering does not touch the bus state of the command line.
+static void I2C_poll_run(uint8_t entry){
+	uint32_t timestamp = TIMER_now();
+	uint8_t missed = POLL_advance(entry, timestamp);
+	uint8_t poll_status = I2C_NO_ERROR;
+	uint8_t *result;
+	uint16_t result_length = 0;
+	uint8_t sample[6 + POLL_READ_LENGTH];
+	
+	I2C_engine_start(POLL_program(entry), I2C_ENGINE_CHECKED | I2C_ENGINE_PRESENCE);
+	I2C_engine_wait();
+	poll_status = I2C_engine_finish();
+	
+	result = I2C_result_data(&result_length);
+	timestamp *= TIMER_TICK_US;
+	
+	if(binary_flag){
+		sample[0] = entry;
+		sample[1] = timestamp;
+		sample[2] = timestamp >> 8;
+		sample[3] = timestamp >> 16;
+		sample[4] = timestamp >> 24;
+		sample[5] = missed;
+		
+		for(uint16_t index = 0; index < result_length; index++) sample[6 + index] = result[index];
+		
+		system_error_handler(BINARY_transmit_frame(BINARY_OP_POLL_SAMPLE, poll_status, sample, 6 + result_length));
+	}
+	else{
+		// P, entry, microseconds since power up, status and skipped periods, then the bytes read as usual
+		system_error_handler(UART_transmit('P'));
+		system_error_handler(UART_transmit_digits(entry, 1));
+		system_error_handler(UART_transmit(' '));
+		system_error_handler(UART_transmit_digits(timestamp, 8));
+		system_error_handler(UART_transmit(' '));
+		system_error_handler(UART_transmit_digits(poll_status, 2));
+		system_error_handler(UART_transmit(' '));
+		system_error_handler(UART_transmit_digits(missed, 2));
+		system_error_handler(UART_transmit(' '));
+		
+		for(uint16_t index = 0; index < result_length; index++) system_error_handler(UART_transmit_hex(result[index]));
+		
+		system_error_handler(UART_transmit('\n'));
+	}
+	
+	I2C_result_clear();
+}
+
+// Read the Alert Response Address for as long as SMBALERT# stays low and report every device that answers it, in whichever form the host is listening for.
+// Nobody answering ends it too. Like a scheduled poll, nothing here touches the bus state of the command line.
+static void I2C_alert_run(){
+	uint8_t program[10];
+	uint8_t report[3];
+	uint8_t report_length = 0;
+	uint8_t response_status = I2C_NO_ERROR;
+	uint8_t alert_status = I2C_NO_ERROR;
+	uint8_t *result;
+	uint16_t result_length = 0;
+	
+	for(uint8_t responses = 0; (responses < I2C_ALERT_RESPONSES) && ALERT_asserted(); responses++){
+		// The address has not been scanned as a device, so it is read without the presence check
+		program[0] = I2C_OP_ADDRESS;
+		program[1] = (I2C_ALERT_RESPONSE_ADDRESS << 1) | 0x01;
+		program[2] = I2C_OP_READ;
+		program[3] = 1;
+		program[4] = I2C_OP_END;
+		
+		I2C_engine_start(program, I2C_ENGINE_CHECKED);
+		I2C_engine_wait();
+		response_status = I2C_engine_finish();
+		
+		result = I2C_result_data(&result_length);
+		report[0] = ((response_status == I2C_NO_ERROR) && (result_length != 0)) ? (result[0] >> 1) : 0xFF;
+		report_length = 1;
+		alert_status = response_status;
+		I2C_result_clear();
+		
+		if((response_status == I2C_NO_ERROR) && (alert_mode == I2C_ALERT_STATUS_WORD)){
+			program[0] = I2C_OP_ADDRESS;
+			program[1] = report[0] << 1;
+			program[2] = I2C_OP_WRITE;
+			program[3] = 1;
+			program[4] = PMBUS_STATUS_WORD;
+			program[5] = I2C_OP_ADDRESS;
+			program[6] = (report[0] << 1) | 0x01;
+			program[7] = I2C_OP_READ;
+			program[8] = 2;
+			program[9] = I2C_OP_END;
 			
-			I2C_write(data_array[receive_index] - 1000);
-			if((I2C_status |= I2C_timeout()) & I2C_BUS_RESET) break;
+			I2C_engine_start(program, I2C_ENGINE_CHECKED);
+			I2C_engine_wait();
+			alert_status = I2C_engine_finish();
 			
-			// Check if the current I2C state matches SLA+W+ACK or SLA+R+ACK
-			if((I2C_get_status() != 0x18) && (I2C_get_status() != 0x40)){
-				  I2C_status |= I2C_ADDR_NACK;
-				  break;
-			}
+			result = I2C_result_data(&result_length);
+			report[1] = (result_length > 0) ? result[0] : 0;
+			report[2] = (result_length > 1) ? result[1] : 0;
+			report_length = 3;
+			I2C_result_clear();
 		}
 		
+		if(binary_flag){
+			system_error_handler(BINARY_transmit_frame(BINARY_OP_ALERT, alert_status, report, report_length));
+		}
 		else{
-			// If SLA+R was transmitted and an ACK was received, then the next data byte should be interpreted as the number of bytes to ACK.
-			if (I2C_get_status() == 0x40){
-				
-				// Exit if desired bytes to read back is zero to avoid a bus error.
-				if (data_array[receive_index] == 0){
-					I2C_status |= I2C_NO_BYTES_REQUESTED;
-					break;
-				}
-				
-				// Send ACKs based on data byte value, but send a NACK on the last transmission.
-				while(data_array[receive_index] > 1){
-					I2C_ACK();
-					if((I2C_status |= I2C_timeout()) & I2C_BUS_RESET) break;
-					
-					// Check if the current I2C state does not match data_byte+ACK
-					if(I2C_get_status() != 0x50){
-						I2C_status |= I2C_DATA_READ_ACK_FAIL;
-						break;
-					}
-					
-					system_error_handler(UART_transmit_hex(I2C_read()));
-					
-					data_array[receive_index]--;
-				}
-				I2C_NACK();
-				if((I2C_status |= I2C_timeout()) & I2C_BUS_RESET) break;
-				
-				// Check if the current I2C state does not match data_byte+ACK
-				if(I2C_get_status() != 0x58){
-					I2C_status |= I2C_DATA_READ_NACK_FAIL;
-					break;
-				}
-				
-				system_error_handler(UART_transmit_hex(I2C_read()));
-				system_error_handler(UART_transmit('\n'));
-			}
-			else{
-				I2C_write(data_array[receive_index]);
-				if((I2C_status |= I2C_timeout()) & I2C_BUS_RESET) break;
+			// ~, address, status, then STATUS_WORD as it was read
+			system_error_handler(UART_transmit('~'));
+			system_error_handler(UART_transmit_digits(report[0], 2));
+			system_error_handler(UART_transmit(' '));
+			system_error_handler(UART_transmit_digits(alert_status, 2));
+			
+			if(report_length > 1){
+				system_error_handler(UART_transmit(' '));
+				system_error_handler(UART_transmit_hex(report[1]));
+				system_error_handler(UART_transmit_hex(report[2]));
 			}
+			
+			system_error_handler(UART_transmit('\n'));
 		}
+		
+		if(response_status != I2C_NO_ERROR) break;
+	}
+}
+
+// The trace so far, oldest first, as TWSR status or TRACE_EVENTS value and tick with ; between entries. Clears the trace.
+static uint8_t TRACE_report(){
+	uint8_t system_status = NO_ERROR;
+	uint8_t event = 0;
+	uint16_t tick = 0;
+	
+	for(uint8_t index = 0; index < TRACE_length(); index++){
+		TRACE_entry(index, &event, &tick);
+		
+		if(index != 0) system_status |= UART_transmit(';');
+		system_status |= UART_transmit_digits(event, 2);
+		system_status |= UART_transmit(' ');
+		system_status |= UART_transmit_digits(tick, 4);
+	}
+	system_status |= UART_transmit('\n');
+	
+	TRACE_clear();
+	
+	return system_status;
+}
+
+// Send whether the cache is on with its hits and misses since it was last turned on, off or emptied
+static uint8_t CACHE_report(){
+	uint8_t system_status = NO_ERROR;
+	uint16_t hits = 0;
+	uint16_t misses = 0;
+	
+	CACHE_counts(&hits, &misses);
+	
+	system_status |= UART_transmit_digits(CACHE_enabled(), 2);
+	system_status |= UART_transmit(' ');
+	system_status |= UART_transmit_digits(hits, 4);
+	system_status |= UART_transmit(' ');
+	system_status |= UART_transmit_digits(misses, 4);
+	system_status |= UART_transmit('\n');
+	
+	return system_status;
+}
+
+// Tell the host about a fault the error handler recovered from, in whichever form it is listening for: ! with the SYSTEM_ERROR_CODES value and how many times it has happened
+static void system_fault_report(uint8_t fault){
+	uint8_t system_status = NO_ERROR;
+	uint8_t report[2];
+	uint16_t count = system_fault_count(fault);
+	
+	if(binary_flag){
+		report[0] = count;
+		report[1] = count >> 8;
+		system_status = BINARY_transmit_frame(BINARY_OP_FAULT, fault, report, 2);
+	}
+	else{
+		system_status |= UART_transmit('!');
+		system_status |= UART_transmit_digits(fault, 2);
+		system_status |= UART_transmit(' ');
+		system_status |= UART_transmit_digits(count, 4);
+		system_status |= UART_transmit('\n');
+	}
+	
+	// A report that does not get out is a fault of its own, and counts towards latching
+	if(system_status == NO_ERROR){
+		system_fault_reported();
+	}
+	else{
+		system_error_handler(system_status);
+	}
+}
+
+// Counters as decimal numbers in STATS_COUNTERS order followed by RX overruns, then min/average/max microseconds of each of STATS_TIMERS
+static uint8_t STATS_report(){
+	uint8_t system_status = NO_ERROR;
+	uint32_t timing[3];
+	
+	for(uint8_t counter = 0; counter < STATS_COUNTER_COUNT; counter++){
+		system_status |= UART_transmit_decimal(STATS_counter(counter));
+		system_status |= UART_transmit(' ');
+	}
+	system_status |= UART_transmit_decimal(STATS_rx_overruns());
+	
+	for(uint8_t timer = 0; timer < STATS_TIMER_COUNT; timer++){
+		STATS_timing(timer, &timing[0], &timing[1], &timing[2]);
+		
+		for(uint8_t index = 0; index < 3; index++){
+			system_status |= UART_transmit(index ? '/' : ' ');
+			system_status |= UART_transmit_decimal(timing[index]);
+		}
+	}
+	
+	system_status |= UART_transmit('\n');
+	
+	return system_status;
+}
+
+// Same numbers for a COUNTERS frame, returns the data length
+static uint8_t STATS_pack(uint8_t *data){
+	uint8_t length = 0;
+	uint32_t value[3];
+	
+	for(uint8_t counter = 0; counter < STATS_COUNTER_COUNT; counter++){
+		value[0] = STATS_counter(counter);
+		
+		for(uint8_t shift = 0; shift < 32; shift += 8) data[length++] = value[0] >> shift;
+	}
+	
+	for(uint8_t timer = 0; timer < STATS_TIMER_COUNT; timer++){
+		STATS_timing(timer, &value[0], &value[1], &value[2]);
+		
+		for(uint8_t index = 0; index < 3; index++){
+			for(uint8_t shift = 0; shift < 32; shift += 8) data[length++] = value[index] >> shift;
+		}
+	}
+	
+	value[0] = STATS_rx_overruns();
+	data[length++] = value[0];
+	data[length++] = value[0] >> 8;
+	
+	return length;
+}
+
+uint8_t display_help(){
+	uint8_t system_status = NO_ERROR;
+	
+	uint16_t help_index = 0;
+	// Kept in flash and sent a byte at a time, a copy in SRAM would take most of it
+	static const char help[] PROGMEM = "I2C Dongle | XX = Hex Addr/Data | XX! = Start + Addr + W | XX? = Start + Addr + R | XX$ = Write Data Byte or ACKs | XX& = Same + PEC | XX+ = Block Read of up to XX Bytes | XX# = Block Read + PEC | XX!W = Stream the Rest of the Line to XX as Hex Byte Pairs, XON/XOFF Flow Control, FF if Not After a Write Address | MMMMEEEEX = Repeat This Line's Read Until Its Word & MMMM = EEEE, Answers Data, Reads and = on a Match | IIIITTTTY = X Reads Every IIII ms for up to TTTT ms | XXYYN = EEPROM Has XX Address Bytes and YY Byte Pages | XX!YYYYG = Program EEPROM XX From YYYY With the Rest of the Line, Answers Bytes Written | XX!YYYYJ = Same + Verify | XX!YY!CCNNZ = Read NN Bytes of Command CC From Each Device, None = All Found by the Last Scan, Answers Address Status Data of Each | ; = STOP, Then Start Another Transaction, Each Answers With Its Reads and ;Status | XX~ = SMBALERT# Reports ~Address Status, 00 = Off, 01 = On, 02 = With STATUS_WORD | 1= = Trace Bus States, Sends the Trace So Far as TWSR Tick;... in 4 us Ticks | 0= = Same, Then Stop | XX: = Read Cache On Hits Misses, Then 00 = Off, 01 = On, 02 = Empty, Simulator Builds Only | CCNN| = Cache Command CC With NN = 01, Not With 00, Answers 01 if Cached | XX> = Keep This Line as Macro XX, Alone Frees It | XX< = Run Macro XX | YY!XX< = Same on Device YY | @ = Find Slave Addresses | XXYYL = Presence Bitmap of XX to YY | XXYYR = Same Probing With Reads | ^ = Current I2C Bus State | T = 400kHz | S = 100kHz | V = 10kHz | % = Current Bus Frequency | XXXXK = Set Bus Frequency to XXXX kHz, Returns Actual kHz | XXXXO = Bus Timeout of XXXX ms, +8000 = SMBus 25 ms Clock Low Timeout | M = Binary Frame Mode | XXXXP = Repeat This Line Every XXXX ms | XXQ = Stop Repeat XX (FF = All) | U = Transactions Written Read NACKs Resets Overruns, Min/Avg/Max us of Parse Bus Drain | 1U = Same, Then Reset\n";
+	
+	while(pgm_read_byte(&help[help_index]) != '\0'){
+		system_status |= UART_transmit(pgm_read_byte(&help[help_index]));
+		help_index++;
+		_delay_us(10);
+	}
+	
+	return system_status;
+}
+
+// Every address gets its own START and STOP. A NACK only means nobody is there, anything else is a bus problem that ends the scan.
+uint8_t I2C_scan_addresses(uint8_t first, uint8_t last, uint8_t probe, uint8_t *bitmap){
+	uint8_t I2C_status = I2C_NO_ERROR;
+	uint8_t program[5] = {I2C_OP_ADDRESS, 0x00, I2C_OP_END, 0x00, I2C_OP_END};
+	
+	for(uint8_t index = 0; index < 16; index++) bitmap[index] = 0;
+	
+	if(probe == I2C_PROBE_READ_BYTE){
+		program[2] = I2C_OP_READ;
+		program[3] = 1;
+	}
+	
+	// Stops at 0x7F whatever the range, which also keeps the address from wrapping around
+	for(uint8_t address = first; (address <= last) && (address < 0x80); address++){
+		program[1] = (address << 1) | (probe == I2C_PROBE_READ_BYTE);
+		
+		I2C_engine_start(program, I2C_ENGINE_CHECKED);
+		I2C_engine_wait();
+		I2C_status = I2C_engine_finish();
+		I2C_result_clear();
+		
+		if((I2C_status != I2C_NO_ERROR) && (I2C_status != I2C_ADDR_NACK)) break;
+		
+		I2C_presence_record(address, I2C_status == I2C_NO_ERROR);
+		if(I2C_status == I2C_NO_ERROR) bitmap[address >> 3] |= 1 << (address & 0x07);
+		
+		I2C_status = I2C_NO_ERROR;
 	}
-	I2C_stop();
-	I2C_status |= I2C_release_bus();
 	
 	return I2C_status;
 }
 
-uint8_t UART_receive_array(uint8_t I2C_status){
-	// 258 is the maximum bytes that a single address/command can be. The first byte in the array is dedicated to the index, so instead of 259, the buffer must be 260 to allow for overflow checking/handling
-	uint16_t UART_receive_buffer_length = 261;
-	uint16_t UART_receive_buffer[UART_receive_buffer_length];
-	UART_receive_buffer[0] = 1;
+// Run program every interval ms until the first two bytes it reads, low byte first, are expected once masked, or timeout ms have gone by.
+// A run that fails on the bus ends the polling with its status. The bytes read by the last run are left in the result buffer.
+uint8_t I2C_poll_until(uint8_t *program, uint16_t mask, uint16_t expected, uint16_t interval, uint16_t timeout, uint16_t *iterations, uint8_t *matched){
+	uint32_t started = TIMER_now();
+	uint32_t next = started;
+	uint8_t I2C_status = I2C_NO_ERROR;
+	uint8_t state = I2C_ENGINE_IDLE;
+	uint8_t *result;
+	uint16_t result_length = 0;
+	uint16_t value = 0;
 	
-	uint8_t stacked_data = 0; // Initializer for incoming data to be concatenated. This is an 8 bit value to prevent sending too large of a value over I2C by rolling over when greater than 255
-	char UART_data = '\0'; // Initialize to a known state
-	uint8_t special_char = 0; // If a special character is detected, then prevent the I2C transaction from taking place
+	*iterations = 0;
+	*matched = 0;
+	
+	while(1){
+		I2C_result_clear();
+		I2C_engine_start(program, I2C_ENGINE_CHECKED | I2C_ENGINE_PRESENCE);
+		
+		// Only the first bytes are compared, a read too long for the result buffer just has the start of it dropped along the way
+		while((state = I2C_engine_wait()) == I2C_ENGINE_FULL){
+			I2C_result_clear();
+			I2C_engine_resume();
+		}
+		
+		I2C_status = I2C_engine_finish();
+		(*iterations)++;
+		
+		if(I2C_status != I2C_NO_ERROR) return I2C_status;
+		
+		result = I2C_result_data(&result_length);
+		value = (result_length > 0) ? result[0] : 0;
+		if(result_length > 1) value |= (uint16_t)result[1] << 8;
+		
+		if((value & mask) == expected){
+			*matched = 1;
+			return I2C_status;
+		}
+		
+		// Give up rather than start a read that would land past the timeout
+		next += (uint32_t)interval * TIMER_TICKS_PER_MS;
+		if((next - started) > ((uint32_t)timeout * TIMER_TICKS_PER_MS)) return I2C_status;
+		
+		TIMER_wait(next);
+	}
+}
+
+// One round of the work done while the host is quiet: the transaction on the bus is timed, and once the bus is free alerts and due scheduled polls are run, or the CPU sleeps until the next one.
+// Returns the engine state, anything other than RUNNING or IDLE is a transaction waiting to be collected.
+static uint8_t I2C_idle(){
+	uint8_t engine_state = I2C_engine_poll();
+	uint8_t poll_entry = POLL_NONE;
+	uint32_t poll_due = 0;
+	
+	if(engine_state != I2C_ENGINE_IDLE) return engine_state;
+	
+	// A device pulled SMBALERT# low, find out which one before a poll takes the bus. The edge is used up even while alerts are off.
+	if(ALERT_pending() && (alert_mode != I2C_ALERT_OFF)){
+		I2C_alert_run();
+		return engine_state;
+	}
+	
+	poll_entry = POLL_next(&poll_due);
+	
+	if(poll_entry == POLL_NONE){
+		// Nothing scheduled, only the host or a timer overflow wakes the CPU
+		poll_due = TIMER_now() + 0x7FFFFFFF;
+	}
+	else if((int32_t)(TIMER_now() - poll_due) >= 0){
+		I2C_poll_run(poll_entry);
+		return engine_state;
+	}
+	
+	UART_wait(poll_due);
+	
+	return engine_state;
+}
+
+// Wait for the next character of the line being parsed. A host that stops partway through a line still gets the previous line's results, and its deadlines and scheduled polls are kept.
+static uint8_t UART_receive_line(uint8_t *I2C_status){
+	uint8_t engine_state = I2C_ENGINE_IDLE;
 	
-	uint8_t message_index = 0;
-	uint8_t enabled_message[] = "Broadcast Mode Enabled!\n";
-	uint8_t disabled_message[] = "Broadcast Mode Disabled!\n";
+	while(!UART_available()){
+		engine_state = I2C_idle();
+		
+		if((engine_state != I2C_ENGINE_RUNNING) && (engine_state != I2C_ENGINE_IDLE)) *I2C_status = I2C_collect(*I2C_status);
+	}
 	
-	while ((UART_data != '\n') && (UART_receive_buffer[0] < UART_receive_buffer_length)){
-		while (!(UCSR0A & (1<<RXC0))); // Wait for data to be received, it is okay for this to be an unbounded loop, as we want to keep looking until there is something here.
+	return UART_receive();
+}
 
-		UART_data = toupper(UDR0); // Get received data and convert it to uppercase
+// Parse one command line and carry it out. Kept apart from UART_receive_array() so a binary frame's handler does not sit on top of this one's locals on the stack.
+static uint8_t __attribute__((noinline)) ASCII_receive_array(uint8_t I2C_status){
+	// The line is parsed straight into a transaction program, which is checked for room before every character
+	I2C_program_begin();
+	
+	uint32_t stacked_data = 0; // Initializer for incoming data to be concatenated. Commands can take up to 32 bits, but only the low 8 bits are sent over I2C so a byte still rolls over when greater than 255
+	char UART_data = '\0'; // Initialize to a known state
+	uint8_t special_char = 0; // If a special character is detected, then prevent the I2C transaction from taking place
+	uint8_t bitmap[16]; // Scan results, address n is bit n % 8 of byte n / 8
+	uint16_t timeout_ms = 0;
+	uint8_t smbus_timeout = 0;
+	uint16_t iterations = 0;
+	uint8_t matched = 0;
+	uint8_t *result;
+	uint16_t result_length = 0;
+	uint8_t devices[I2C_GATHER_DEVICES];
+	uint8_t device_count = 0;
+	
+	while ((UART_data != '\n') && I2C_program_room()){
+		UART_data = toupper(UART_receive_line(&I2C_status)); // Wait for received data and convert it to uppercase, it is okay for this to be unbounded, as we want to keep looking until there is something here.
+		
+		// Anything other than hex digits, step markers and the newline answers the host or uses the bus, so the previous line's transaction has to finish first
+		if(!isxdigit(UART_data) && !strchr("!?$&+#;\n", UART_data)) I2C_status = I2C_collect(I2C_status);
 		
 		switch(UART_data){
 			case 'A' ... 'F': // Convert received char data to int and fill up the lower nibble in stacked data by shifting up previous lower nibble to upper nibble.
@@ -221,98 +833,315 @@ uint8_t UART_receive_array(uint8_t I2C_status){
 				break;
 			
 			case '!': // Start + ADDR + W indicator
-				UART_receive_buffer[UART_receive_buffer[0]] = (stacked_data << 1) + 1000;
-				UART_receive_buffer[0]++;
+				I2C_program_address(stacked_data << 1);
 				stacked_data = 0;
 				break;
 			
 			case '?': // Start + ADDR + R indicator
-				UART_receive_buffer[UART_receive_buffer[0]] = ((stacked_data << 1) + 1) + 1000;
-				UART_receive_buffer[0]++;
+				I2C_program_address((stacked_data << 1) + 1);
 				stacked_data = 0;
 				break;
 			
 			case '$': // data byte indicator
-				UART_receive_buffer[UART_receive_buffer[0]] = (stacked_data);
-				UART_receive_buffer[0]++;
+				I2C_program_data(stacked_data, 0);
+				stacked_data = 0;
+				break;
+			
+			case '&': // Data byte followed by PEC
+				I2C_program_data(stacked_data, I2C_FLAG_PEC);
 				stacked_data = 0;
 				break;
 			
-			case '&': // Block data byte indicator or PEC read indicator if used with normal data byte
-				UART_receive_buffer[UART_receive_buffer[0]] = (stacked_data + 1);
-				UART_receive_buffer[0]++;
-				stacked_data = 0;
+			case '+': // Block read, the slave's count byte sets the length with this byte as the limit (00 = 255)
+				I2C_program_data(stacked_data, I2C_FLAG_BLOCK);
+				stacked_data = 0;
+				break;
+			
+			case '#': // Block read followed by PEC
+				I2C_program_data(stacked_data, I2C_FLAG_BLOCK | I2C_FLAG_PEC);
+				stacked_data = 0;
+				break;
+			
+			case 'W': // Write the rest of the line to the bus as hex byte pairs while it arrives, with no length limit and the STOP at the newline. Answers FF and drops the line if it cannot be streamed.
+				// The bytes have to follow a write address, not a read step with no START in between
+				if((I2C_status != I2C_NO_ERROR) || (I2C_program_transactions != 1) || I2C_program_read_next || I2C_program_read_last){
+					while(UART_receive_line(&I2C_status) != '\n');
+					
+					system_error_handler(UART_transmit_hex(0xFF));
+					system_error_handler(UART_transmit('\n'));
+				}
+				else{
+					I2C_collect_batch = 0;
+					I2C_stream_line((broadcast_flag == 0) ? (I2C_ENGINE_CHECKED | I2C_ENGINE_PRESENCE) : 0);
+				}
+				
+				UART_data = '\n';
+				special_char = 1;
+				break;
+			
+			case 'N': // EEPROM geometry, XX address bytes and YY bytes per page (00 = 256). Answers with the setting, 0N only reads it.
+				if(((stacked_data >> 8) == 1) || ((stacked_data >> 8) == 2)){
+					eeprom_address_bytes = stacked_data >> 8;
+					eeprom_page_size = (stacked_data & 0xFF) ? (stacked_data & 0xFF) : 256;
+				}
+				
+				system_error_handler(UART_transmit_digits(((uint16_t)eeprom_address_bytes << 8) | (eeprom_page_size & 0xFF), 4));
+				system_error_handler(UART_transmit('\n'));
+				
+				special_char = 1;
+				break;
+			
+			case 'G': // Program the EEPROM addressed on this line from memory address XXXX with the hex byte pairs on the rest of it, a page at a time
+			case 'J': // Same, reading every page back to check it
+				if((I2C_status != I2C_NO_ERROR) || (I2C_program_transactions != 1) || (I2C_programs[I2C_program_select][0] != I2C_OP_ADDRESS) || I2C_program_read_next){
+					while(UART_receive_line(&I2C_status) != '\n');
+				}
+				else{
+					I2C_status = I2C_eeprom_line(stacked_data, UART_data == 'J');
+				}
+				
+				UART_data = '\n';
+				special_char = 1;
+				break;
+			
+			case ';': // Transaction separator, everything on the line runs back to back as a batch
+				I2C_program_separate();
+				stacked_data = 0;
+				break;
+			
+			case '@': // Find all addresses connected to bus
+				if (I2C_status != I2C_NO_ERROR) break;
+				
+				I2C_status = I2C_scan_addresses(0x00, 0x7F, I2C_PROBE_QUICK_WRITE, bitmap);
+				
+				for(uint8_t address = 0; address < 0x80; address++){
+					if(bitmap[address >> 3] & (1 << (address & 0x07))) system_error_handler(UART_transmit_hex(address));
+				}
+				system_error_handler(UART_transmit('\n'));
+				
+				special_char = 1;
+				break;
+			
+			case 'L': // Scan addresses XX to YY with a quick write and answer with the presence bitmap, 0L scans 08 to 77
+			case 'R': // Same with a read byte probe
+				if (I2C_status != I2C_NO_ERROR) break;
+				
+				if(stacked_data == 0) stacked_data = 0x0877;
+				
+				I2C_status = I2C_scan_addresses(stacked_data >> 8, stacked_data, (UART_data == 'R') ? I2C_PROBE_READ_BYTE : I2C_PROBE_QUICK_WRITE, bitmap);
+				
+				for(uint8_t index = 0; index < 16; index++) system_error_handler(UART_transmit_digits(bitmap[index], 2));
+				system_error_handler(UART_transmit('\n'));
+				
+				special_char = 1;
+				break;
+			
+			case '%': // Returns current transmission speed in kHz
+				if (I2C_status != I2C_NO_ERROR) break;
+			
+				system_error_handler(UART_transmit_decimal((I2C_get_frequency() + 500) / 1000));
+				system_error_handler(UART_transmit('\n'));
+			
+				special_char = 1;
+				break;
+			
+			case 'K': // Set transmission speed to XXXX kHz, or the closest rate below it, and return the actual speed in kHz the way % does
+				if (I2C_status != I2C_NO_ERROR) break;
+				
+				system_error_handler(I2C_set_frequency(stacked_data * 1000UL));
+				system_error_handler(UART_transmit_decimal((I2C_get_frequency() + 500) / 1000));
+				system_error_handler(UART_transmit('\n'));
+				
+				special_char = 1;
+				break;
+			
+			case '^': // Returns current state of I2C bus and attempts to reset the bus if an error is detected
+				system_error_handler(UART_transmit_hex(I2C_status));
+				system_error_handler(UART_transmit('\n'));
+				
+				if (I2C_status != I2C_NO_ERROR) I2C_reset_bus();
+				
+				I2C_status = I2C_NO_ERROR;
+				
+				special_char = 1;
+				break;
+				
+			case '*':
+				if(stacked_data == 0){
+					broadcast_flag = 0;
+					
+					system_error_handler(UART_transmit_flash(disabled_message));
+				}
+				else{
+					broadcast_flag = 1;
+					
+					system_error_handler(UART_transmit_flash(enabled_message));
+				}
+
+				special_char = 1;
+				break;
+			
+			case 'M': // Switch to binary frames, the rest of this line is skipped while hunting for the first sync byte
+				system_error_handler(UART_transmit_flash(binary_message));
+				
+				binary_flag = 1;
+				
+				special_char = 1;
+				break;
+			
+			case 'P': // Repeat the transaction built so far on this line every XXXX ms instead of running it once, answers with its entry or FF if it does not fit
+				system_error_handler(UART_transmit_hex(POLL_add(I2C_programs[I2C_program_select], I2C_program_end(), stacked_data)));
+				system_error_handler(UART_transmit('\n'));
+				
+				I2C_program_begin();
+				stacked_data = 0;
+				
+				special_char = 1;
+				break;
+			
+			case 'Q': // Stop repeating entry XX, or all of them with FF, answers with how many are left
+				system_error_handler(UART_transmit_hex(POLL_remove(stacked_data)));
+				system_error_handler(UART_transmit('\n'));
+				
+				special_char = 1;
+				break;
+			
+			case 'O': // Set the bus operation timeout to XXXX ms, adding 8000 turns on the SMBus clock low timeout as well. Answers with the setting, 0O only reads it.
+				if(stacked_data != 0) I2C_set_timeout(stacked_data & 0x7FFF, (stacked_data >> 15) & 0x01);
+				
+				timeout_ms = I2C_get_timeout(&smbus_timeout);
+				system_error_handler(UART_transmit_digits(timeout_ms | ((uint16_t)smbus_timeout << 15), 4));
+				system_error_handler(UART_transmit('\n'));
+				
+				special_char = 1;
+				break;
+			
+			case 'U': // Report the counters and timings, 1U also starts them over
+				system_error_handler(STATS_report());
+				
+				if(stacked_data != 0) STATS_reset();
+				
+				special_char = 1;
+				break;
+			
+			case 'X': // Repeat the read built so far on this line until its first two bytes, low byte first, masked with MMMM equal EEEE. Answers with the last bytes read, the reads taken and = if it matched, or FF if the line is not one transaction or the bus is in error.
+				if((I2C_status != I2C_NO_ERROR) || (I2C_program_transactions != 1)){
+					system_error_handler(UART_transmit_hex(0xFF));
+					system_error_handler(UART_transmit('\n'));
+					
+					special_char = 1;
+					break;
+				}
+				
+				I2C_program_end();
+				I2C_status = I2C_poll_until(I2C_programs[I2C_program_select], stacked_data >> 16, stacked_data, poll_until_interval, poll_until_timeout, &iterations, &matched);
+				
+				result = I2C_result_data(&result_length);
+				for(uint16_t index = 0; index < result_length; index++) system_error_handler(UART_transmit_hex(result[index]));
+				I2C_result_clear();
+				
+				system_error_handler(UART_transmit(' '));
+				system_error_handler(UART_transmit_digits(iterations, 4));
+				system_error_handler(UART_transmit(matched ? '=' : '!'));
+				system_error_handler(UART_transmit('\n'));
+				
+				I2C_program_begin();
+				stacked_data = 0;
+				
+				special_char = 1;
+				break;
+			
+			case 'Y': // Read every IIII ms for up to TTTT ms in X. Answers with the setting, 0Y only reads it.
+				if(stacked_data != 0){
+					poll_until_interval = (stacked_data >> 16) ? (stacked_data >> 16) : 1;
+					poll_until_timeout = stacked_data;
+				}
+				
+				system_error_handler(UART_transmit_digits(((uint32_t)poll_until_interval << 16) | poll_until_timeout, 8));
+				system_error_handler(UART_transmit('\n'));
+				
+				special_char = 1;
 				break;
 			
-			case '#': // Block data byte PEC indicator
-				UART_receive_buffer[UART_receive_buffer[0]] = (stacked_data + 2);
-				UART_receive_buffer[0]++;
+			case 'Z': // Read YY bytes of command code XX from every device addressed with ! on this line, or every device the last scans found if there are none, all in one go. Answers with address, status and bytes of each, or FF if the line holds anything else.
+				if(I2C_status != I2C_NO_ERROR){
+					special_char = 1;
+					break;
+				}
+				
+				device_count = I2C_gather_line(devices);
+				
+				if((device_count == 0xFF) || ((stacked_data & 0xFF) == 0)){
+					system_error_handler(UART_transmit_hex(0xFF));
+					system_error_handler(UART_transmit('\n'));
+				}
+				else{
+					if(device_count == 0) device_count = I2C_gather_found(devices);
+					
+					I2C_status = I2C_gather_report(I2C_status, devices, device_count, stacked_data >> 8, stacked_data);
+				}
+				
+				I2C_program_begin();
 				stacked_data = 0;
+				
+				special_char = 1;
 				break;
 			
-			case '@': // Find all addresses connected to bus
-				if (I2C_status != I2C_NO_ERROR) break;
+			case '~': // SMBALERT# handling, XX is one of I2C_ALERT_MODES. Answers with the mode, then reports any device already holding the line low.
+				if(stacked_data <= I2C_ALERT_STATUS_WORD) alert_mode = stacked_data;
 				
-				I2C_status = I2C_scan_addresses();
+				system_error_handler(UART_transmit_digits(alert_mode, 2));
 				system_error_handler(UART_transmit('\n'));
 				
+				if(alert_mode != I2C_ALERT_OFF) I2C_alert_run();
+				
 				special_char = 1;
 				break;
 			
-			case '%': // Returns current transmission speed in kHz
-				if (I2C_status != I2C_NO_ERROR) break;
-			
-				switch(I2C_get_speed()){
-					case 0x48:
-						system_error_handler(UART_transmit('1'));
-						system_error_handler(UART_transmit('0'));
-						break;
-					case 0x0C:
-						system_error_handler(UART_transmit('4'));
-						system_error_handler(UART_transmit('0'));
-						break;
-					case 0xC0:
-						system_error_handler(UART_transmit('1'));
-						break;
-				}
-				system_error_handler(UART_transmit('0'));
-				system_error_handler(UART_transmit('\n'));
+			case '=': // Send the bus trace and clear it, then trace from here on with 1= or stop with 0=
+				system_error_handler(TRACE_report());
+				TRACE_enable(stacked_data != 0);
+				
+				special_char = 1;
+				break;
 			
+			case ':': // Send the cache state, then 00: turns it off, 01: on and 02: empties it, anything else leaves it as it is
+				system_error_handler(CACHE_report());
+				if(stacked_data <= CACHE_EMPTY) CACHE_mode(stacked_data);
+				
 				special_char = 1;
 				break;
 			
-			case '^': // Returns current state of I2C bus and attempts to reset the bus if an error is detected
-				system_error_handler(UART_transmit_hex(I2C_status));
+			case '|': // CCNN| puts command code CC on the cache allowlist with NN = 01 or takes it off with 00, any other NN only asks. Answers whether it is on the list.
+				if((stacked_data & 0xFF) <= 1) CACHE_allow(stacked_data >> 8, stacked_data & 0xFF);
+				system_error_handler(UART_transmit_hex(CACHE_allowed(stacked_data >> 8)));
 				system_error_handler(UART_transmit('\n'));
 				
-				if (I2C_status != I2C_NO_ERROR) I2C_reset_bus();
+				special_char = 1;
+				break;
+			
+			case '>': // Keep the transaction built so far on this line in EEPROM as macro XX, or free the entry if there is none. Answers with the entry or FF if it does not fit.
+				system_error_handler(UART_transmit_hex(MACRO_store(stacked_data, I2C_programs[I2C_program_select], I2C_program_length ? I2C_program_end() : 0)));
+				system_error_handler(UART_transmit('\n'));
 				
-				I2C_status = I2C_NO_ERROR;
+				I2C_program_begin();
+				stacked_data = 0;
 				
 				special_char = 1;
 				break;
+			
+			case '<': // Run macro XX as if it had been typed here, with an address written before it taking the place of the macro's own device. Answers FF if there is no such macro.
+				device_count = I2C_gather_line(devices);
 				
-			case '*':
-				message_index = 0;
-
-				if(stacked_data == 0){
-					broadcast_flag = 0;
-					
-					while(disabled_message[message_index] != '\0'){
-						system_error_handler(UART_transmit(disabled_message[message_index]));
-						message_index++;
-					}
-				}
-				else{
-					broadcast_flag = 1;
+				if((device_count > 1) || !I2C_program_macro(stacked_data, device_count ? devices[0] : 0xFF)){
+					system_error_handler(UART_transmit_hex(MACRO_NONE));
+					system_error_handler(UART_transmit('\n'));
 					
-					while(enabled_message[message_index] != '\0'){
-						system_error_handler(UART_transmit(enabled_message[message_index]));
-						message_index++;
-					}
+					I2C_program_begin();
+					special_char = 1;
 				}
-
-				special_char = 1;
+				
+				stacked_data = 0;
 				break;
 			
 			case 'H': // Display help and hot keys
@@ -356,17 +1185,502 @@ uint8_t UART_receive_array(uint8_t I2C_status){
 				break;
 		}
 	}
-	// If the buffer has more than 258 elements, then there was an overflow
-	if(UART_receive_buffer[0] > (UART_receive_buffer_length - 1)) system_error_handler(UART_RECEIVE_DATA_OVERFLOW);
+	// If the program filled up before the newline, then there was an overflow. The rest of the line is thrown away and none of it runs.
+	if(UART_data != '\n'){
+		system_error_handler(UART_RECEIVE_DATA_OVERFLOW);
+		
+		while(UART_receive_line(&I2C_status) != '\n');
+		special_char = 1;
+	}
 	
+	// Parsing this line overlapped the previous line's transaction, which has to be off the bus before this one starts and decides whether it runs at all
+	I2C_status = I2C_collect(I2C_status);
+	
+	// Broadcast mode runs the same steps without checking the bus state machine, for when no slave is there to answer
 	if((I2C_status == I2C_NO_ERROR) && (special_char == 0)){
-		if(broadcast_flag == 0){
-			I2C_status = I2C_arbitration(UART_receive_buffer);
-		}
+		I2C_collect_batch = (I2C_program_transactions > 1);
 		
-		else{
-			I2C_broadcast(UART_receive_buffer);
+		// A batch answers one line per transaction, so its reads are not split into lines of their own
+		I2C_program_start(((broadcast_flag == 0) ? (I2C_ENGINE_CHECKED | I2C_ENGINE_PRESENCE | I2C_ENGINE_CACHED) : 0) | (I2C_collect_batch ? 0 : I2C_ENGINE_MARK_READS));
+	}
+	
+	return I2C_status;
+}
+
+uint8_t UART_receive_array(uint8_t I2C_status){
+	uint8_t engine_state = I2C_ENGINE_IDLE;
+	
+	// Reported between lines so it cannot land in the middle of a response
+	if(system_fault_pending() != NO_ERROR) system_fault_report(system_fault_pending());
+	
+	// While the host is quiet, watch the previous line's transaction so its results and status come back the moment it ends, and run scheduled polls once the bus is free
+	while(!UART_available()){
+		STATS_drain_check();
+		
+		engine_state = I2C_idle();
+		
+		if((engine_state != I2C_ENGINE_RUNNING) && (engine_state != I2C_ENGINE_IDLE)) return I2C_collect(I2C_status);
+	}
+	
+	command_started_at = TIMER_now();
+	
+	if(binary_flag) return BINARY_receive_array(I2C_status);
+	
+	return ASCII_receive_array(I2C_status);
+}
+
+// Translate the steps of a binary transaction request, starting at payload_index, into a transaction program. STOP steps are only taken in a batch.
+static uint8_t BINARY_build_transaction(uint8_t *payload, uint8_t payload_index, uint8_t payload_length, uint8_t batch){
+	uint8_t count = 0;
+	uint8_t flags = 0;
+	uint16_t read_total = 0;
+	
+	I2C_program_begin();
+	
+	while(payload_index < payload_length){
+		uint8_t remaining = payload_length - payload_index - 1;
+		
+		// A step can take more program bytes than payload bytes, so many short reads can still run out of room
+		if(!I2C_program_room()) return BINARY_MALFORMED_REQUEST;
+		
+		flags = ((payload[payload_index] & BINARY_STEP_PEC) ? I2C_FLAG_PEC : 0) | ((payload[payload_index] & BINARY_STEP_BLOCK) ? I2C_FLAG_BLOCK : 0);
+		
+		switch(payload[payload_index++] & ~(BINARY_STEP_PEC | BINARY_STEP_BLOCK)){
+			case BINARY_STEP_WRITE_ADDRESS:
+				if(remaining < 1) return BINARY_MALFORMED_REQUEST;
+				
+				I2C_program_address((payload[payload_index++] & 0x7F) << 1);
+				break;
+			
+			case BINARY_STEP_READ_ADDRESS:
+				if((remaining < 2) || (payload[payload_index + 1] == 0)) return BINARY_MALFORMED_REQUEST;
+				
+				I2C_program_address(((payload[payload_index++] & 0x7F) << 1) + 1);
+				// A block read takes the count byte on top of as many data bytes as its limit allows
+				read_total += payload[payload_index] + ((flags & I2C_FLAG_PEC) != 0) + ((flags & I2C_FLAG_BLOCK) != 0);
+				I2C_program_data(payload[payload_index++], flags);
+				break;
+			
+			case BINARY_STEP_WRITE_DATA:
+				if((remaining < 1) || ((remaining - 1) < payload[payload_index])) return BINARY_MALFORMED_REQUEST;
+				
+				count = payload[payload_index++];
+				while(count--){
+					if(!I2C_program_room()) return BINARY_MALFORMED_REQUEST;
+					
+					// The PEC flag goes on the last byte, which closes the write step
+					I2C_program_data(payload[payload_index++], count ? 0 : (flags & I2C_FLAG_PEC));
+				}
+				break;
+			
+			case BINARY_STEP_STOP:
+				if(!batch) return BINARY_MALFORMED_REQUEST;
+				
+				I2C_program_separate();
+				break;
+			
+			default:
+				return BINARY_MALFORMED_REQUEST;
+		}
+	}
+	
+	// Everything read has to fit in a single response frame next to the opcode and status, and in a batch next to each transaction's status and length
+	if(batch) read_total += 2 * I2C_program_transactions;
+	
+	return (read_total > (BINARY_PAYLOAD_LENGTH - 2)) ? BINARY_MALFORMED_REQUEST : BINARY_NO_ERROR;
+}
+
+// Run the program built from a frame and answer with its results, one frame for a transaction or every transaction's status, length and data for a batch.
+// The payload is free to collect the response in, since the program has its own copy of the steps.
+static uint8_t BINARY_run_program(uint8_t opcode, uint8_t I2C_status, uint8_t *payload, uint8_t batch){
+	uint8_t payload_length = 0;
+	uint8_t state = I2C_ENGINE_IDLE;
+	uint8_t *result;
+	uint16_t result_length = 0;
+	
+	if(!batch){
+		// The whole response goes out in one frame, so there is nothing to overlap the bus with
+		if(I2C_status == I2C_NO_ERROR){
+			I2C_program_start((broadcast_flag == 0) ? (I2C_ENGINE_CHECKED | I2C_ENGINE_PRESENCE | I2C_ENGINE_CACHED) : 0);
+			I2C_engine_wait();
+			I2C_status = I2C_engine_finish();
 		}
+		
+		result = I2C_result_data(&result_length);
+		STATS_drain_begin();
+		system_error_handler(BINARY_transmit_frame(opcode, I2C_status, result, result_length));
+		STATS_drain_queued();
+		I2C_result_clear();
+		
+		return I2C_status;
+	}
+	
+	if(I2C_status != I2C_NO_ERROR){
+		system_error_handler(BINARY_transmit_frame(opcode, I2C_status, 0, 0));
+		return I2C_status;
+	}
+	
+	I2C_program_start((broadcast_flag == 0) ? (I2C_ENGINE_CHECKED | I2C_ENGINE_PRESENCE | I2C_ENGINE_CACHED) : 0);
+	
+	do{
+		state = I2C_engine_wait();
+		payload[payload_length++] = I2C_engine_finish();
+		I2C_status |= payload[payload_length - 1] & I2C_BUS_RESET;
+		
+		result = I2C_result_data(&result_length);
+		payload[payload_length++] = result_length;
+		for(uint16_t index = 0; index < result_length; index++) payload[payload_length++] = result[index];
+		I2C_result_clear();
+		
+		if(state == I2C_ENGINE_STOPPED) I2C_engine_resume();
+	}while(state == I2C_ENGINE_STOPPED);
+	
+	STATS_drain_begin();
+	system_error_handler(BINARY_transmit_frame(opcode, I2C_status, payload, payload_length));
+	STATS_drain_queued();
+	
+	return I2C_status;
+}
+
+uint8_t BINARY_receive_array(uint8_t I2C_status){
+	uint8_t *payload = I2C_programs[(I2C_program_select + 1) % I2C_PROGRAMS]; // The bank that is not being built is free once the bus is, a frame on the stack would take an eighth of the SRAM
+	uint8_t payload_length = 0;
+	uint8_t opcode = 0;
+	uint8_t state = I2C_ENGINE_IDLE;
+	uint8_t response[4 * (STATS_COUNTER_COUNT + (3 * STATS_TIMER_COUNT)) + 2]; // Big enough for the counters, which is the longest reply built here
+	uint32_t setting = 0; // Clock rate or timeout being reported
+	uint16_t iterations = 0;
+	uint8_t matched = 0;
+	uint8_t *result;
+	uint16_t result_length = 0;
+	uint16_t read_length = 0;
+	uint8_t device_count = 0;
+	uint8_t event = 0; // Trace entry being packed
+	uint16_t tick = 0;
+	uint16_t hits = 0; // Cache counts being reported
+	uint16_t misses = 0;
+	
+	// Every opcode waits for its own transactions, so only an ASCII line sent right before M can still be on the bus
+	I2C_status = I2C_collect(I2C_status);
+	payload_length = BINARY_receive_frame(payload);
+	
+	if(payload_length == 0){
+		system_error_handler(BINARY_transmit_frame(BINARY_OP_ERROR, BINARY_FRAME_ERROR, 0, 0));
+		return I2C_status;
+	}
+	
+	opcode = payload[0];
+	
+	switch(opcode){
+		case BINARY_OP_IDENTIFY:
+			response[0] = '=';
+			system_error_handler(BINARY_transmit_frame(opcode, I2C_status, response, 1));
+			break;
+		
+		case BINARY_OP_TRANSACTION:
+		case BINARY_OP_BATCH:
+			if(BINARY_build_transaction(payload, 1, payload_length, opcode == BINARY_OP_BATCH) != BINARY_NO_ERROR){
+				system_error_handler(BINARY_transmit_frame(BINARY_OP_ERROR, BINARY_MALFORMED_REQUEST, 0, 0));
+				break;
+			}
+			
+			I2C_status = BINARY_run_program(opcode, I2C_status, payload, opcode == BINARY_OP_BATCH);
+			break;
+		
+		case BINARY_OP_EEPROM:
+			if(payload_length < 7){
+				system_error_handler(BINARY_transmit_frame(BINARY_OP_ERROR, BINARY_MALFORMED_REQUEST, 0, 0));
+				break;
+			}
+			
+			if(I2C_status != I2C_NO_ERROR){
+				system_error_handler(BINARY_transmit_frame(opcode, I2C_status, 0, 0));
+				break;
+			}
+			
+			I2C_eeprom_begin(I2C_programs[I2C_program_select], payload[1], payload[2], payload[3], payload[4] | (payload[5] << 8), payload[6]);
+			for(uint8_t index = 7; index < payload_length; index++) I2C_eeprom_write(payload[index]);
+			I2C_status = I2C_eeprom_end();
+			
+			response[0] = I2C_eeprom_written();
+			response[1] = I2C_eeprom_written() >> 8;
+			response[2] = (I2C_status == I2C_NO_ERROR) && I2C_eeprom_matched();
+			system_error_handler(BINARY_transmit_frame(opcode, I2C_status, response, 3));
+			break;
+		
+		case BINARY_OP_POLL_UNTIL:
+			if((payload_length < 9) || (BINARY_build_transaction(payload, 9, payload_length, 0) != BINARY_NO_ERROR)){
+				system_error_handler(BINARY_transmit_frame(BINARY_OP_ERROR, BINARY_MALFORMED_REQUEST, 0, 0));
+				break;
+			}
+			
+			if(I2C_status != I2C_NO_ERROR){
+				system_error_handler(BINARY_transmit_frame(opcode, I2C_status, 0, 0));
+				break;
+			}
+			
+			I2C_program_end();
+			I2C_status = I2C_poll_until(I2C_programs[I2C_program_select], payload[1] | (payload[2] << 8), payload[3] | (payload[4] << 8), payload[5] | (payload[6] << 8), payload[7] | (payload[8] << 8), &iterations, &matched);
+			
+			// The program has its own copy of the steps, so the payload is free to collect the response in
+			result = I2C_result_data(&result_length);
+			payload[0] = iterations;
+			payload[1] = iterations >> 8;
+			payload[2] = matched;
+			for(uint16_t index = 0; (index < result_length) && (index < (BINARY_PAYLOAD_LENGTH - 5)); index++) payload[3 + index] = result[index];
+			
+			system_error_handler(BINARY_transmit_frame(opcode, I2C_status, payload, 3 + ((result_length < (BINARY_PAYLOAD_LENGTH - 5)) ? result_length : (BINARY_PAYLOAD_LENGTH - 5))));
+			I2C_result_clear();
+			break;
+		
+		case BINARY_OP_GATHER:
+			// The device list is copied out of the way of the response
+			device_count = (payload_length < 3) ? 0xFF : (payload_length - 3);
+			
+			if(device_count == 0) device_count = I2C_gather_found(response);
+			else if(device_count <= I2C_GATHER_DEVICES) memcpy(response, payload + 3, device_count);
+			
+			if((device_count > I2C_GATHER_DEVICES) || (payload[2] == 0) || ((device_count * (2 + payload[2])) > BINARY_PAYLOAD_LENGTH)){
+				system_error_handler(BINARY_transmit_frame(BINARY_OP_ERROR, BINARY_MALFORMED_REQUEST, 0, 0));
+				break;
+			}
+			
+			if(I2C_status != I2C_NO_ERROR){
+				system_error_handler(BINARY_transmit_frame(opcode, I2C_status, 0, 0));
+				break;
+			}
+			
+			// Every device gets the same sized slot, so the host can find a device's bytes without walking the ones before it
+			result_length = 2 + payload[2];
+			payload_length = 0;
+			if(device_count != 0) I2C_gather_start(response, device_count, payload[1], payload[2]);
+			
+			for(uint8_t index = 0; index < device_count; index++){
+				state = I2C_engine_wait();
+				
+				payload[index * result_length] = response[index];
+				payload[(index * result_length) + 1] = I2C_engine_finish();
+				I2C_status |= payload[(index * result_length) + 1] & I2C_BUS_RESET;
+				
+				result = I2C_result_data(&read_length);
+				for(uint16_t byte = 0; byte < (result_length - 2); byte++) payload[(index * result_length) + 2 + byte] = (byte < read_length) ? result[byte] : 0;
+				I2C_result_clear();
+				
+				payload_length += result_length;
+				
+				if(state != I2C_ENGINE_STOPPED) break;
+				
+				I2C_engine_resume();
+			}
+			
+			STATS_drain_begin();
+			system_error_handler(BINARY_transmit_frame(opcode, I2C_status, payload, payload_length));
+			STATS_drain_queued();
+			break;
+		
+		case BINARY_OP_ALERT_MODE:
+			if((payload_length > 1) && (payload[1] > I2C_ALERT_STATUS_WORD)){
+				system_error_handler(BINARY_transmit_frame(BINARY_OP_ERROR, BINARY_MALFORMED_REQUEST, 0, 0));
+				break;
+			}
+			
+			if(payload_length > 1) alert_mode = payload[1];
+			
+			response[0] = alert_mode;
+			system_error_handler(BINARY_transmit_frame(opcode, I2C_status, response, 1));
+			
+			if(alert_mode != I2C_ALERT_OFF) I2C_alert_run();
+			break;
+		
+		case BINARY_OP_TRACE:
+			// The argument is used before the trace is packed over it
+			if(payload_length > 1) TRACE_enable(payload[1] != 0);
+			
+			payload_length = 0;
+			
+			for(uint8_t index = 0; index < TRACE_length(); index++){
+				TRACE_entry(index, &event, &tick);
+				payload[payload_length++] = event;
+				payload[payload_length++] = tick;
+				payload[payload_length++] = tick >> 8;
+			}
+			
+			TRACE_clear();
+			system_error_handler(BINARY_transmit_frame(opcode, I2C_status, payload, payload_length));
+			break;
+		
+		case BINARY_OP_CACHE:
+			if((payload_length > 2) && (payload_length & 0x01)){
+				system_error_handler(BINARY_transmit_frame(BINARY_OP_ERROR, BINARY_MALFORMED_REQUEST, 0, 0));
+				break;
+			}
+			
+			CACHE_counts(&hits, &misses);
+			response[0] = CACHE_enabled();
+			response[1] = hits;
+			response[2] = hits >> 8;
+			response[3] = misses;
+			response[4] = misses >> 8;
+			
+			if((payload_length > 1) && (payload[1] <= CACHE_EMPTY)) CACHE_mode(payload[1]);
+			for(uint8_t index = 2; index < payload_length; index += 2) CACHE_allow(payload[index], payload[index + 1]);
+			
+			system_error_handler(BINARY_transmit_frame(opcode, I2C_status, response, 5));
+			break;
+		
+		case BINARY_OP_MACRO_STORE:
+			if((payload_length < 2) || ((payload_length > 2) && (BINARY_build_transaction(payload, 2, payload_length, 1) != BINARY_NO_ERROR))){
+				system_error_handler(BINARY_transmit_frame(BINARY_OP_ERROR, BINARY_MALFORMED_REQUEST, 0, 0));
+				break;
+			}
+			
+			response[0] = MACRO_store(payload[1], I2C_programs[I2C_program_select], (payload_length > 2) ? I2C_program_end() : 0);
+			I2C_program_begin();
+			
+			if(response[0] == MACRO_NONE){
+				system_error_handler(BINARY_transmit_frame(BINARY_OP_ERROR, BINARY_NO_ROOM, 0, 0));
+				break;
+			}
+			
+			system_error_handler(BINARY_transmit_frame(opcode, I2C_status, response, 1));
+			break;
+		
+		case BINARY_OP_MACRO_RUN:
+			if((payload_length < 2) || !I2C_program_macro(payload[1], (payload_length > 2) ? payload[2] : 0xFF)){
+				system_error_handler(BINARY_transmit_frame(BINARY_OP_ERROR, BINARY_MALFORMED_REQUEST, 0, 0));
+				break;
+			}
+			
+			I2C_status = BINARY_run_program(opcode, I2C_status, payload, I2C_program_transactions > 1);
+			break;
+		
+		case BINARY_OP_STATUS:
+			system_error_handler(BINARY_transmit_frame(opcode, I2C_status, 0, 0));
+			
+			if (I2C_status != I2C_NO_ERROR) I2C_reset_bus();
+			
+			I2C_status = I2C_NO_ERROR;
+			break;
+		
+		case BINARY_OP_GET_SPEED:
+			response[0] = I2C_get_speed();
+			response[1] = TWSR & ((1 << TWPS1) | (1 << TWPS0));
+			system_error_handler(BINARY_transmit_frame(opcode, I2C_status, response, 2));
+			break;
+		
+		case BINARY_OP_SET_SPEED:
+			if((payload_length < 2) || (payload[1] > 2)){
+				system_error_handler(BINARY_transmit_frame(BINARY_OP_ERROR, BINARY_MALFORMED_REQUEST, 0, 0));
+				break;
+			}
+			
+			if (I2C_status == I2C_NO_ERROR){
+				if(payload[1] == 0) system_error_handler(I2C_set_speed_very_slow());
+				if(payload[1] == 1) system_error_handler(I2C_set_speed_standard());
+				if(payload[1] == 2) system_error_handler(I2C_set_speed_fast());
+			}
+			
+			system_error_handler(BINARY_transmit_frame(opcode, I2C_status, 0, 0));
+			break;
+		
+		case BINARY_OP_BROADCAST:
+			if(payload_length < 2){
+				system_error_handler(BINARY_transmit_frame(BINARY_OP_ERROR, BINARY_MALFORMED_REQUEST, 0, 0));
+				break;
+			}
+			
+			broadcast_flag = (payload[1] != 0);
+			system_error_handler(BINARY_transmit_frame(opcode, I2C_status, 0, 0));
+			break;
+		
+		case BINARY_OP_POLL_ADD:
+			if((payload_length < 3) || (BINARY_build_transaction(payload, 3, payload_length, 0) != BINARY_NO_ERROR)){
+				system_error_handler(BINARY_transmit_frame(BINARY_OP_ERROR, BINARY_MALFORMED_REQUEST, 0, 0));
+				break;
+			}
+			
+			response[0] = POLL_add(I2C_programs[I2C_program_select], I2C_program_end(), payload[1] | (payload[2] << 8));
+			
+			if(response[0] == POLL_NONE){
+				system_error_handler(BINARY_transmit_frame(BINARY_OP_ERROR, BINARY_NO_ROOM, 0, 0));
+				break;
+			}
+			
+			system_error_handler(BINARY_transmit_frame(opcode, I2C_status, response, 1));
+			break;
+		
+		case BINARY_OP_POLL_REMOVE:
+			if(payload_length < 2){
+				system_error_handler(BINARY_transmit_frame(BINARY_OP_ERROR, BINARY_MALFORMED_REQUEST, 0, 0));
+				break;
+			}
+			
+			response[0] = POLL_remove(payload[1]);
+			system_error_handler(BINARY_transmit_frame(opcode, I2C_status, response, 1));
+			break;
+		
+		case BINARY_OP_SCAN:
+			if((payload_length < 4) || (payload[3] > I2C_PROBE_READ_BYTE)){
+				system_error_handler(BINARY_transmit_frame(BINARY_OP_ERROR, BINARY_MALFORMED_REQUEST, 0, 0));
+				break;
+			}
+			
+			if(I2C_status != I2C_NO_ERROR){
+				system_error_handler(BINARY_transmit_frame(opcode, I2C_status, 0, 0));
+				break;
+			}
+			
+			I2C_status = I2C_scan_addresses(payload[1], payload[2], payload[3], response);
+			system_error_handler(BINARY_transmit_frame(opcode, I2C_status, response, 16));
+			break;
+		
+		case BINARY_OP_FREQUENCY:
+			if((payload_length != 1) && (payload_length < 5)){
+				system_error_handler(BINARY_transmit_frame(BINARY_OP_ERROR, BINARY_MALFORMED_REQUEST, 0, 0));
+				break;
+			}
+			
+			if((payload_length >= 5) && (I2C_status == I2C_NO_ERROR)){
+				setting = payload[1] | ((uint32_t)payload[2] << 8) | ((uint32_t)payload[3] << 16) | ((uint32_t)payload[4] << 24);
+				system_error_handler(I2C_set_frequency(setting));
+			}
+			
+			setting = I2C_get_frequency();
+			response[0] = setting;
+			response[1] = setting >> 8;
+			response[2] = setting >> 16;
+			response[3] = setting >> 24;
+			system_error_handler(BINARY_transmit_frame(opcode, I2C_status, response, 4));
+			break;
+		
+		case BINARY_OP_TIMEOUT:
+			if((payload_length != 1) && (payload_length < 4)){
+				system_error_handler(BINARY_transmit_frame(BINARY_OP_ERROR, BINARY_MALFORMED_REQUEST, 0, 0));
+				break;
+			}
+			
+			if(payload_length >= 4) I2C_set_timeout(payload[1] | (payload[2] << 8), payload[3] != 0);
+			
+			setting = I2C_get_timeout(&response[2]);
+			response[0] = setting;
+			response[1] = setting >> 8;
+			system_error_handler(BINARY_transmit_frame(opcode, I2C_status, response, 3));
+			break;
+		
+		case BINARY_OP_COUNTERS:
+			system_error_handler(BINARY_transmit_frame(opcode, I2C_status, response, STATS_pack(response)));
+			
+			if((payload_length >= 2) && (payload[1] != 0)) STATS_reset();
+			break;
+		
+		case BINARY_OP_ASCII:
+			system_error_handler(BINARY_transmit_frame(opcode, I2C_status, 0, 0));
+			binary_flag = 0;
+			break;
+		
+		default:
+			system_error_handler(BINARY_transmit_frame(BINARY_OP_ERROR, BINARY_UNKNOWN_OPCODE, 0, 0));
+			break;
 	}
 	
 	return I2C_status;
@@ -10,12 +10,23 @@
 
 uint8_t display_help();
 
-uint8_t I2C_scan_addresses();												// Find all devices connected to I2C bus
+enum I2C_PROBE_STYLES{
+	I2C_PROBE_QUICK_WRITE				= 0x00,	// START, SLA+W, STOP
+	I2C_PROBE_READ_BYTE				= 0x01	// START, SLA+R, one byte NACK'd, STOP. For devices that act on a quick write, like some write protect latches
+};
 
-void I2C_broadcast(uint16_t *data_array);						// I2C interpreter that does not check if any slave devices are connected. This can be used to check that the master is operating properly on its own.
+enum I2C_ALERT_MODES{
+	I2C_ALERT_OFF					= 0x00,	// SMBALERT# is ignored
+	I2C_ALERT_ADDRESS				= 0x01,	// Read the Alert Response Address and report the device that answers
+	I2C_ALERT_STATUS_WORD				= 0x02	// Same, then read that device's STATUS_WORD into the report
+};
 
-uint8_t I2C_arbitration(uint16_t *data_array);			// I2C interpreter that checks the state machine of the I2C peripheral. This can only be used when there is at least one slave device on the bus.
+uint8_t I2C_scan_addresses(uint8_t first, uint8_t last, uint8_t probe, uint8_t *bitmap);		// Find the devices from first to last, setting bit n % 8 of bitmap[n / 8] for each address n that answers
+
+uint8_t I2C_poll_until(uint8_t *program, uint16_t mask, uint16_t expected, uint16_t interval, uint16_t timeout, uint16_t *iterations, uint8_t *matched);		// Repeat a read until its first word matches, see smbus_bridge.c
 
 uint8_t UART_receive_array(uint8_t data_byte);		  // Receive data from PC serial terminal and parse it according to its value
 
+uint8_t BINARY_receive_array(uint8_t I2C_status);		// Receive one binary frame from the PC and carry out its opcode, used instead of the ASCII parser once binary mode is enabled
+
 #endif /* SMBUS_BRIDGE_H_ */
@@ -0,0 +1,107 @@
+/*
+ * stats.c
+ *
+ * Created: 10/17/2026 3:26:41 PM
+ *  Author: aparady
+ */ 
+
+#ifndef F_CPU
+#warning "F_CPU not defined!"
+
+#define F_CPU 16000000UL
+#endif
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "stats.h"
+#include "arduino_drivers.h"
+
+// Some of these are counted from the TWI interrupt, so they are only read with interrupts off
+static volatile uint32_t STATS_counters[STATS_COUNTER_COUNT];
+
+static uint32_t STATS_minimum[STATS_TIMER_COUNT];
+static uint32_t STATS_maximum[STATS_TIMER_COUNT];
+static uint32_t STATS_total[STATS_TIMER_COUNT];
+static uint32_t STATS_samples[STATS_TIMER_COUNT];
+
+static uint16_t STATS_rx_overrun_base = 0; // The UART driver's count when the counters were last reset
+
+static uint32_t STATS_drain_start = 0;
+static uint8_t STATS_drain_open = 0;
+
+void STATS_count(uint8_t counter){
+	STATS_counters[counter]++;
+}
+
+void STATS_time(uint8_t timer, uint32_t ticks){
+	if(!STATS_samples[timer] || ticks < STATS_minimum[timer]) STATS_minimum[timer] = ticks;
+	if(ticks > STATS_maximum[timer]) STATS_maximum[timer] = ticks;
+	
+	STATS_total[timer] += ticks;
+	STATS_samples[timer]++;
+}
+
+// Called as a response starts going out. One still in the transmit buffer is closed first if it can be, otherwise it goes untimed.
+void STATS_drain_begin(){
+	STATS_drain_check();
+	
+	STATS_drain_start = TIMER_now();
+	STATS_drain_open = 0;
+}
+
+void STATS_drain_queued(){
+	UART_mark();
+	STATS_drain_open = 1;
+}
+
+// Called whenever the main loop has a moment, the response is timed once the last of it has left the buffer
+void STATS_drain_check(){
+	uint32_t drained_at = 0;
+	
+	if(!STATS_drain_open) return;
+	
+	if(UART_mark_passed(&drained_at)){
+		STATS_time(STATS_DRAIN, drained_at - STATS_drain_start);
+		STATS_drain_open = 0;
+	}
+}
+
+uint32_t STATS_counter(uint8_t counter){
+	uint8_t interrupts = SREG;
+	uint32_t value;
+	
+	cli();
+	value = STATS_counters[counter];
+	SREG = interrupts;
+	
+	return value;
+}
+
+void STATS_timing(uint8_t timer, uint32_t *minimum, uint32_t *average, uint32_t *maximum){
+	*minimum = STATS_samples[timer] ? (STATS_minimum[timer] * TIMER_TICK_US) : 0;
+	*average = STATS_samples[timer] ? ((STATS_total[timer] / STATS_samples[timer]) * TIMER_TICK_US) : 0;
+	*maximum = STATS_maximum[timer] * TIMER_TICK_US;
+}
+
+uint16_t STATS_rx_overruns(){
+	return UART_get_rx_overflows() - STATS_rx_overrun_base;
+}
+
+void STATS_reset(){
+	uint8_t interrupts = SREG;
+	
+	cli();
+	for(uint8_t counter = 0; counter < STATS_COUNTER_COUNT; counter++) STATS_counters[counter] = 0;
+	SREG = interrupts;
+	
+	for(uint8_t timer = 0; timer < STATS_TIMER_COUNT; timer++){
+		STATS_minimum[timer] = 0;
+		STATS_maximum[timer] = 0;
+		STATS_total[timer] = 0;
+		STATS_samples[timer] = 0;
+	}
+	
+	STATS_rx_overrun_base = UART_get_rx_overflows();
+	STATS_drain_open = 0; // A response still going out was queued before the reset
+}
@@ -0,0 +1,52 @@
+/*
+ * stats.h
+ *
+ * Created: 10/17/2026 3:26:41 PM
+ *  Author: aparady
+ */ 
+
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <avr/io.h>
+
+/*
+Counters and timings kept since power up or the last STATS_reset(). Times are taken on the Timer1 tick and handed out in microseconds.
+*/
+
+enum STATS_COUNTERS{
+	STATS_TRANSACTIONS				= 0x00,	// Programs run by the engine, including scan probes and scheduled polls
+	STATS_BYTES_WRITTEN				= 0x01,	// Address, data and PEC bytes sent
+	STATS_BYTES_READ				= 0x02,	// Data bytes clocked in, including block counts and PECs
+	STATS_NACKS					= 0x03,	// Address or data bytes the slave did not acknowledge
+	STATS_BUS_RESETS				= 0x04,	// Times SCL was pulsed to shake off a slave
+	STATS_COUNTER_COUNT
+};
+
+enum STATS_TIMERS{
+	STATS_PARSE					= 0x00,	// Command line or frame received and turned into a program
+	STATS_BUS					= 0x01,	// Program started until its STOP was issued
+	STATS_DRAIN					= 0x02,	// Results started going out until the last of them left the transmit buffer
+	STATS_TIMER_COUNT
+};
+
+void STATS_count(uint8_t counter);
+
+void STATS_time(uint8_t timer, uint32_t ticks);
+
+void STATS_drain_begin();
+
+void STATS_drain_queued();
+
+void STATS_drain_check();
+
+uint32_t STATS_counter(uint8_t counter);
+
+void STATS_timing(uint8_t timer, uint32_t *minimum, uint32_t *average, uint32_t *maximum);
+
+uint16_t STATS_rx_overruns();
+
+void STATS_reset();
+
+#endif /* STATS_H_ */
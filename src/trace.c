@@ -0,0 +1,70 @@
+/*
+ * trace.c
+ *
+ * Created: 10/17/2026 5:48:52 PM
+ *  Author: aparady
+ */ 
+
+#ifndef F_CPU
+#warning "F_CPU not defined!"
+
+#define F_CPU 16000000UL
+#endif
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "trace.h"
+#include "arduino_drivers.h"
+
+// Filled from the TWI interrupt, so they are only read with interrupts off
+static volatile uint8_t TRACE_events[TRACE_LENGTH];
+static volatile uint16_t TRACE_ticks[TRACE_LENGTH];
+static volatile uint8_t TRACE_head = 0; // Where the next entry goes
+static volatile uint8_t TRACE_count = 0; // Entries held, up to TRACE_LENGTH
+
+static uint8_t TRACE_on = 0;
+
+void TRACE_enable(uint8_t enabled){
+	TRACE_on = enabled;
+}
+
+uint8_t TRACE_enabled(){
+	return TRACE_on;
+}
+
+// Cheap enough for the interrupt, and a single test while tracing is off
+void TRACE_record(uint8_t event){
+	if(!TRACE_on) return;
+	
+	TRACE_events[TRACE_head] = event;
+	TRACE_ticks[TRACE_head] = TIMER_now();
+	TRACE_head = (TRACE_head + 1) & (TRACE_LENGTH - 1);
+	
+	if(TRACE_count < TRACE_LENGTH) TRACE_count++;
+}
+
+uint8_t TRACE_length(){
+	return TRACE_count;
+}
+
+// Entry 0 is the oldest one held
+void TRACE_entry(uint8_t index, uint8_t *event, uint16_t *tick){
+	uint8_t interrupt_state = SREG;
+	uint8_t position;
+	
+	cli();
+	position = (TRACE_head - TRACE_count + index) & (TRACE_LENGTH - 1);
+	*event = TRACE_events[position];
+	*tick = TRACE_ticks[position];
+	SREG = interrupt_state;
+}
+
+void TRACE_clear(){
+	uint8_t interrupt_state = SREG;
+	
+	cli();
+	TRACE_head = 0;
+	TRACE_count = 0;
+	SREG = interrupt_state;
+}
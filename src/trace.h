@@ -0,0 +1,41 @@
+/*
+ * trace.h
+ *
+ * Created: 10/17/2026 5:48:52 PM
+ *  Author: aparady
+ */ 
+
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <avr/io.h>
+
+/*
+While tracing is on, the TWI interrupt records every TWSR status it sees with the low half of TIMER_now(), so the time between two entries is the difference of their ticks (TIMER_TICK_US each).
+The ring keeps the newest TRACE_LENGTH entries. TWSR statuses always have their low three bits clear, which leaves those values for the engine's own events.
+*/
+
+#ifndef TRACE_LENGTH
+#define TRACE_LENGTH 16 // Must be a power of two so the ring index can wrap with a mask. Every entry takes 3 bytes of SRAM, 16 hold a short transaction and can be raised at compile time for longer ones.
+#endif
+
+enum TRACE_EVENTS{
+	TRACE_START					= 0x01,	// Engine asked for a START or repeated START
+	TRACE_STOP					= 0x02,	// Engine issued the STOP
+	TRACE_TIMEOUT					= 0x03	// TWINT did not come back in time and the bus is being reset
+};
+
+void TRACE_enable(uint8_t enabled);
+
+uint8_t TRACE_enabled();
+
+void TRACE_record(uint8_t event);
+
+uint8_t TRACE_length();
+
+void TRACE_entry(uint8_t index, uint8_t *event, uint16_t *tick);
+
+void TRACE_clear();
+
+#endif /* TRACE_H_ */